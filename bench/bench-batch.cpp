@@ -0,0 +1,67 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <command.hpp>
+#include <batch.hpp>
+
+using namespace pnt_cli;
+
+// a tree of 100 subcommands with a few flags each, as built on every invocation without batch mode
+static std::shared_ptr<Command> buildTree(size_t& calls) {
+    auto root = makeCommand("root", "root command", [] (Command const&, Args) { return 0; });
+    root->addPersistentFlag<bool>("verbose", "verbose output", false, "v");
+    for (int i = 0; i < 100; i++) {
+        auto sub = root->addSubcommand("sub_command_" + std::to_string(i), "sub command", [&calls] (Command const&, Args args) {
+            for (auto arg : args) calls += arg.size();
+            return 0;
+        });
+        sub->addLocalFlag<int>("count", "a count", 0, "c");
+        sub->addLocalFlag<std::string_view>("output", "an output", "", "o");
+    }
+    return root;
+}
+static const char* line = "sub_command_42 -v --count 3 -o out/file.png input_a.png input_b.png";
+
+// Builds the tree and executes a single command line, per invocation
+static void BM_BuildAndExecute(benchmark::State& state) {
+    size_t calls = 0;
+    std::vector<std::string> args{"root", "sub_command_42", "-v", "--count", "3", "-o", "out/file.png", "input_a.png", "input_b.png"};
+    std::vector<char*> argv(args.size());
+    for (auto _ : state) {
+        auto root = buildTree(calls);
+        for (size_t i = 0; i < args.size(); i++) argv[i] = args[i].data();
+        root->execute(argv.size(), argv.data());
+    }
+    benchmark::DoNotOptimize(calls);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BuildAndExecute);
+
+// Dispatches N such command lines read from a file to a tree built once
+static void BM_BatchLines(benchmark::State& state) {
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-bench-" + std::to_string(::getpid()) + ".batch")).string();
+    {
+        std::ofstream file(path);
+        for (int64_t i = 0; i < state.range(0); i++)
+            file << line << '\n';
+    }
+    size_t calls = 0;
+    auto root = buildTree(calls);
+    BatchRunner runner(*root);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    for (auto _ : state) {
+        ::lseek(fd, 0, SEEK_SET);
+        if (!runner.run(fd)) state.SkipWithError("read failed");
+    }
+    ::close(fd);
+    std::filesystem::remove(path);
+    benchmark::DoNotOptimize(calls);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BatchLines)->Arg(1000)->Arg(100000);
@@ -0,0 +1,262 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <regex>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <command.hpp>
+
+using namespace pnt_cli;
+
+static auto noopAction = [] (Command const&, Args) { return 0; };
+
+// expensive to convert custom flag type
+struct Pattern {
+    std::string source;
+    std::regex regex;
+};
+template<>
+Pattern pnt_cli::fromString<Pattern>(const std::string& str) { return Pattern{str, std::regex(str)}; }
+template<>
+std::string pnt_cli::toString<Pattern>(const Pattern& val) { return val.source; }
+
+static void BM_BuildTree(benchmark::State& state) {
+    std::vector<std::string> names;
+    for (int64_t i = 0; i < state.range(0); i++)
+        names.push_back("sub_command_" + std::to_string(i));
+    for (auto _ : state) {
+        auto root = makeCommand("root", "root command", noopAction);
+        root->addPersistentFlag<bool>("verbose", "verbose output", false, "v");
+        for (const auto& name : names) {
+            auto sub = root->addSubcommand(name, "sub command", noopAction);
+            sub->addLocalFlag<int>("count", "a count", 0, "c");
+            sub->addLocalFlag<std::string>("output", "an output", "", "o");
+        }
+        benchmark::DoNotOptimize(root);
+    }
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_BuildTree)->RangeMultiplier(10)->Range(10, 10000)->Complexity(benchmark::oN);
+
+// N subcommands with M flags each
+static void BM_BuildTreeWithFlags(benchmark::State& state) {
+    std::vector<std::string> names, flags;
+    for (int64_t i = 0; i < state.range(0); i++)
+        names.push_back("sub_command_" + std::to_string(i));
+    for (int64_t i = 0; i < state.range(1); i++)
+        flags.push_back("flag_" + std::to_string(i));
+    for (auto _ : state) {
+        auto root = makeCommand("root", "root command", noopAction);
+        for (const auto& name : names) {
+            auto sub = root->addSubcommand(name, "sub command", noopAction);
+            for (const auto& flag : flags)
+                sub->addLocalFlag<int>(flag, "a flag", 0);
+        }
+        benchmark::DoNotOptimize(root);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * (state.range(1) + 1));
+}
+BENCHMARK(BM_BuildTreeWithFlags)->ArgsProduct({{10, 100, 1000}, {1, 10, 50}});
+
+// Looks up a persistent flag of the root from the leaf of a chain of subcommands
+static void BM_GetFlagAtDepth(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    root->addPersistentFlag<int>("verbosity", "verbosity level", 1, "v");
+    auto leaf = root;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        leaf = leaf->addSubcommand("sub_command", "sub command", noopAction);
+        leaf->addPersistentFlag<int>("level_" + std::to_string(i), "a flag", 0);
+    }
+    root->finalize();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(leaf->getFlag<int>("verbosity"));
+}
+BENCHMARK(BM_GetFlagAtDepth)->RangeMultiplier(4)->Range(1, 64);
+// The same flag read through the handle returned when it was added
+static void BM_FlagHandleGet(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    auto verbosity = root->addPersistentFlag<int>("verbosity", "verbosity level", 1, "v");
+    for (auto _ : state)
+        benchmark::DoNotOptimize(verbosity.get());
+}
+BENCHMARK(BM_FlagHandleGet);
+
+// Parses an in memory argv of N args, alternating flags with values and positionals
+static void BM_ParseArgv(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    root->addLocalFlag<int>("count", "a count", 0, "c");
+    root->addLocalFlag<std::string>("output", "an output", "", "o");
+    root->addLocalFlag<bool>("verbose", "verbose output", false, "v");
+    root->finalize();
+    std::vector<std::string> args{"root"};
+    for (int64_t i = 1; args.size() < static_cast<size_t>(state.range(0)); i++) {
+        switch (i % 4) {
+            case 0: args.push_back("--count=" + std::to_string(i)); break;
+            case 1: args.push_back("-o"); args.push_back("out_" + std::to_string(i)); break;
+            case 2: args.push_back("-v"); break;
+            case 3: args.push_back("positional_" + std::to_string(i)); break;
+        }
+    }
+    std::vector<char*> argv(args.size());
+    for (auto _ : state) {
+        // parsing permutes argv
+        for (size_t i = 0; i < args.size(); i++) argv[i] = args[i].data();
+        benchmark::DoNotOptimize(&root->parse(argv.size(), argv.data()));
+    }
+    state.SetItemsProcessed(state.iterations() * args.size());
+}
+BENCHMARK(BM_ParseArgv)->Arg(16)->Arg(1024)->Arg(65536);
+
+// Parses a single N-byte flag value into a copying std::string flag, or a viewing std::string_view one
+template<typename T>
+static void BM_ParseLargeValue(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    root->addLocalFlag<T>("output", "an output", "", "o");
+    root->finalize();
+    std::string arg0 = "root", flag = "-o", value(state.range(0), 'x');
+    for (auto _ : state) {
+        char* argv[] = {arg0.data(), flag.data(), value.data()};
+        benchmark::DoNotOptimize(&root->parse(3, argv));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseLargeValue<std::string>)->Arg(64)->Arg(1 << 20);
+BENCHMARK(BM_ParseLargeValue<std::string_view>)->Arg(64)->Arg(1 << 20);
+
+// Parses 8 pattern flags and reads N of them, only those read are converted
+static void BM_ParseCustomFlags(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    std::vector<FlagHandle<Pattern>> patterns;
+    std::vector<std::string> args{"root"};
+    for (int i = 0; i < 8; i++) {
+        std::string name = "pattern_" + std::to_string(i);
+        patterns.push_back(root->addLocalFlag<Pattern>(name, "a pattern", Pattern{}));
+        args.push_back("--" + name + "=[a-z]+_[0-9]{2,4}(\\.png|\\.jpg)");
+    }
+    root->finalize();
+    std::vector<char*> argv(args.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < args.size(); i++) argv[i] = args[i].data();
+        root->parse(argv.size(), argv.data());
+        for (int64_t i = 0; i < state.range(0); i++)
+            benchmark::DoNotOptimize(&patterns[i]->regex);
+    }
+}
+BENCHMARK(BM_ParseCustomFlags)->Arg(0)->Arg(1)->Arg(8);
+
+// Streams a response file of N paths to an action counting them
+static void BM_ExecuteResponseFile(benchmark::State& state) {
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-bench-" + std::to_string(::getpid()) + ".rsp")).string();
+    {
+        std::ofstream file(path);
+        for (int64_t i = 0; i < state.range(0); i++)
+            file << "some/directory/file_" << i << ".png\n";
+    }
+    size_t count = 0;
+    auto root = makeCommand("root", "root command", [&count] (Command const&, Args args) {
+        for (auto arg : args) count += !arg.empty();
+        return 0;
+    });
+    std::string arg0 = "root", arg1 = "@" + path;
+    for (auto _ : state) {
+        char* argv[] = {arg0.data(), arg1.data()};
+        root->execute(2, argv);
+    }
+    benchmark::DoNotOptimize(count);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_ExecuteResponseFile)->Arg(1000)->Arg(1000000);
+
+// Rejecting a malformed command line through the exception-free API, and by catching
+static void BM_TryExecuteInvalid(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    root->addLocalFlag<int>("count", "a count", 0, "c");
+    std::string arg0 = "root", arg1 = "--count", arg2 = "12x";
+    for (auto _ : state) {
+        char* argv[] = {arg0.data(), arg1.data(), arg2.data()};
+        benchmark::DoNotOptimize(root->tryExecute(3, argv));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TryExecuteInvalid);
+static void BM_ExecuteInvalidThrow(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    root->addLocalFlag<int>("count", "a count", 0, "c");
+    std::string arg0 = "root", arg1 = "--count", arg2 = "12x";
+    for (auto _ : state) {
+        char* argv[] = {arg0.data(), arg1.data(), arg2.data()};
+        try {
+            root->execute(3, argv);
+        } catch (const std::runtime_error& e) {
+            benchmark::DoNotOptimize(e.what());
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ExecuteInvalidThrow);
+
+// Renders help for a root with N subcommands, from scratch and from the cache
+static void BM_RenderHelp(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    root->addPersistentFlag<bool>("verbose", "verbose output", false, "v");
+    for (int64_t i = 0; i < state.range(0); i++)
+        root->addSubcommand("sub_command_" + std::to_string(i), "a sub command that does something useful", noopAction);
+    int width = 100;
+    for (auto _ : state)
+        // a new width invalidates the cache
+        benchmark::DoNotOptimize(root->help(width++ % 50 + 80).data());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_RenderHelp)->RangeMultiplier(10)->Range(10, 1000)->Complexity(benchmark::oN);
+static void BM_CachedHelp(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    for (int64_t i = 0; i < 1000; i++)
+        root->addSubcommand("sub_command_" + std::to_string(i), "a sub command that does something useful", noopAction);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(root->help(100).data());
+}
+BENCHMARK(BM_CachedHelp);
+
+// Startup of a CLI with N top level commands (each with flags and 10 subcommands) running one of them:
+// building every command up front, against registering them lazily. Both grow linearly with N, a lazily
+// registered command costing only its stub (name, description, factory) against its whole subtree
+static void addCommandBody(Command& cmd) {
+    cmd.addLocalFlag<int>("count", "a count", 0, "c");
+    cmd.addLocalFlag<std::string>("output", "an output", "", "o");
+    for (int j = 0; j < 10; j++) {
+        auto sub = cmd.addSubcommand("sub_" + std::to_string(j), "a sub command", noopAction);
+        sub->addLocalFlag<int>("jobs", "parallel jobs", 1, "j");
+    }
+}
+template<bool Lazy>
+static void BM_Startup(benchmark::State& state) {
+    std::vector<std::string> names;
+    for (int64_t i = 0; i < state.range(0); i++)
+        names.push_back("command_" + std::to_string(i));
+    std::vector<std::string> args{"root", "command_0", "sub_3", "-j", "4"};
+    std::vector<char*> argv;
+    for (auto _ : state) {
+        auto root = makeCommand("root", "root command", noopAction);
+        root->addPersistentFlag<bool>("verbose", "verbose output", false, "v");
+        for (const auto& name : names) {
+            if constexpr (Lazy) {
+                root->addLazySubcommand(name, "a command", [] (Command& cmd) {
+                    addCommandBody(cmd);
+                    return Action(noopAction);
+                });
+            } else {
+                addCommandBody(*root->addSubcommand(name, "a command", noopAction));
+            }
+        }
+        argv.clear();
+        for (auto& arg : args) argv.push_back(arg.data());
+        benchmark::DoNotOptimize(root->execute(argv.size(), argv.data()));
+    }
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Startup<false>)->Name("BM_StartupEager")->RangeMultiplier(10)->Range(10, 1000)->Complexity(benchmark::oN);
+BENCHMARK(BM_Startup<true>)->Name("BM_StartupLazy")->RangeMultiplier(10)->Range(10, 1000)->Complexity(benchmark::oN);
@@ -0,0 +1,56 @@
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <command.hpp>
+#include <completion.hpp>
+
+using namespace pnt_cli;
+
+static auto noopAction = [] (Command const&, Args) { return 0; };
+
+// N top level commands with 10 subcommands each, every command with a few flags
+static std::shared_ptr<Command> buildTree(int64_t n) {
+    auto root = makeCommand("root", "root command", noopAction);
+    root->addPersistentFlag<bool>("verbose", "verbose output", false, "v");
+    for (int64_t i = 0; i < n; i++) {
+        auto cmd = root->addSubcommand("command_" + std::to_string(i), "a command", noopAction);
+        cmd->addLocalFlag<int>("count", "a count", 0, "c");
+        for (int j = 0; j < 10; j++) {
+            auto sub = cmd->addSubcommand("sub_" + std::to_string(j), "a sub command", noopAction);
+            sub->addLocalFlag<std::string>("output", "an output", "", "o");
+            sub->addLocalFlag<int>("jobs", "parallel jobs", 1, "j");
+        }
+    }
+    return root;
+}
+
+// What a completion request costs without a cache: building the tree and indexing it
+static void BM_CompleteBuildingTree(benchmark::State& state) {
+    std::vector<const char*> request{"command_1", "sub_"};
+    for (auto _ : state) {
+        auto root = buildTree(state.range(0));
+        benchmark::DoNotOptimize(root->completionIndex().complete(request));
+    }
+    state.SetLabel(std::to_string(state.range(0) * 11 + 1) + " commands");
+}
+BENCHMARK(BM_CompleteBuildingTree)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+// With a cache: mapping the saved index and querying it in place
+static void BM_CompleteFromMappedIndex(benchmark::State& state) {
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-bench-" + std::to_string(::getpid()) + ".cmp")).string();
+    CompletionIndex built = buildTree(state.range(0))->completionIndex();
+    built.save(path);
+    std::vector<const char*> request{"command_1", "sub_"};
+    for (auto _ : state) {
+        CompletionIndex index;
+        index.open(path);
+        benchmark::DoNotOptimize(index.complete(request));
+    }
+    state.SetLabel(std::to_string(built.size()) + " bytes");
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_CompleteFromMappedIndex)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,205 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <flag.hpp>
+
+using namespace pnt_cli;
+
+static std::vector<std::string> flagNames(size_t count) {
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        names.push_back("some_flag_" + std::to_string(i));
+    return names;
+}
+// Flags get shorthands for as long as there are printable characters left
+static void fillFlagSet(FlagSet& fs, const std::vector<std::string>& names) {
+    for (size_t i = 0; i < names.size(); i++) {
+        std::string shorthand = i < 94 ? std::string(1, static_cast<char>('!' + i)) : "";
+        fs.addFlag<int>(names[i], "some description", static_cast<int>(i), shorthand);
+    }
+}
+
+static void BM_FlagSetFindName(benchmark::State& state) {
+    FlagSet fs;
+    auto names = flagNames(state.range(0));
+    fillFlagSet(fs, names);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fs.find<int>(names[i]));
+        if (++i == names.size()) i = 0;
+    }
+}
+BENCHMARK(BM_FlagSetFindName)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_FlagSetFindShorthand(benchmark::State& state) {
+    FlagSet fs;
+    fillFlagSet(fs, flagNames(state.range(0)));
+    size_t count = std::min<size_t>(state.range(0), 94);
+    size_t i = 0;
+    for (auto _ : state) {
+        char shorthand = static_cast<char>('!' + i);
+        benchmark::DoNotOptimize(fs.find<int>(std::string_view(&shorthand, 1)));
+        if (++i == count) i = 0;
+    }
+}
+BENCHMARK(BM_FlagSetFindShorthand)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_FlagSetFindMissing(benchmark::State& state) {
+    FlagSet fs;
+    fillFlagSet(fs, flagNames(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(fs.find<int>("missing_flag"));
+}
+BENCHMARK(BM_FlagSetFindMissing)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_FlagSetGet(benchmark::State& state) {
+    FlagSet fs;
+    auto names = flagNames(state.range(0));
+    fillFlagSet(fs, names);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fs.get<int>(names[i]));
+        if (++i == names.size()) i = 0;
+    }
+}
+BENCHMARK(BM_FlagSetGet)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_FlagSetSet(benchmark::State& state) {
+    FlagSet fs;
+    auto names = flagNames(state.range(0));
+    fillFlagSet(fs, names);
+    const std::string value = "4242";
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fs.set<int>(names[i], value));
+        if (++i == names.size()) i = 0;
+    }
+}
+BENCHMARK(BM_FlagSetSet)->Arg(10)->Arg(100)->Arg(1000);
+
+// Restores the defaults of all N flags, as between the invocations of a long running process
+static void BM_FlagSetReset(benchmark::State& state) {
+    FlagSet fs;
+    fillFlagSet(fs, flagNames(state.range(0)));
+    for (auto _ : state) {
+        fs.reset();
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FlagSetReset)->Arg(10)->Arg(100)->Arg(1000);
+
+static std::vector<std::string> numberStrings(bool integral) {
+    std::vector<std::string> strs;
+    for (int i = 0; i < 1024; i++)
+        strs.push_back(integral ? std::to_string(i * 7919 - 4000000) : std::to_string(i * 0.731 - 300.5));
+    return strs;
+}
+// Representative command line values for each built-in flag type
+template<typename T>
+static std::vector<std::string> conversionInputs() {
+    if constexpr (std::same_as<T, bool>) {
+        return {"true", "false"};
+    } else if constexpr (std::same_as<T, std::string>) {
+        std::vector<std::string> strs;
+        for (int i = 0; i < 1024; i++)
+            strs.push_back("/some/path/to/file_" + std::to_string(i) + ".txt");
+        return strs;
+    } else if constexpr (std::unsigned_integral<T>) {
+        std::vector<std::string> strs;
+        for (unsigned i = 0; i < 1024; i++)
+            strs.push_back(std::to_string(i * 7919u));
+        return strs;
+    } else {
+        return numberStrings(std::integral<T>);
+    }
+}
+template<typename T>
+static void BM_FromString(benchmark::State& state) {
+    auto strs = conversionInputs<T>();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fromString<T>(strs[i]));
+        if (++i == strs.size()) i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FromString<int>);
+BENCHMARK(BM_FromString<unsigned>);
+BENCHMARK(BM_FromString<int64_t>);
+BENCHMARK(BM_FromString<float>);
+BENCHMARK(BM_FromString<double>);
+BENCHMARK(BM_FromString<bool>);
+BENCHMARK(BM_FromString<std::string>);
+
+template<typename T>
+static void BM_TryFromString(benchmark::State& state) {
+    auto strs = conversionInputs<T>();
+    size_t i = 0;
+    T val{};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tryFromString<T>(strs[i], val));
+        if (++i == strs.size()) i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TryFromString<int>);
+BENCHMARK(BM_TryFromString<double>);
+
+// The std::stoi/std::stof based conversions fromString used previously
+static void BM_LegacyStoi(benchmark::State& state) {
+    auto strs = numberStrings(true);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::stoi(strs[i]));
+        if (++i == strs.size()) i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LegacyStoi);
+static void BM_LegacyStof(benchmark::State& state) {
+    auto strs = numberStrings(false);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::stof(strs[i]));
+        if (++i == strs.size()) i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LegacyStof);
+
+static void BM_TryFromStringMalformed(benchmark::State& state) {
+    std::string str = "12abc";
+    int val = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(tryFromString<int>(str, val));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TryFromStringMalformed);
+static void BM_LegacyStoiMalformed(benchmark::State& state) {
+    std::string str = "abc";
+    for (auto _ : state) {
+        try {
+            benchmark::DoNotOptimize(std::stoi(str));
+        } catch (const std::invalid_argument&) {}
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LegacyStoiMalformed);
+
+// A list flag given N comma separated integers in one occurrence
+static void BM_ListFlagSetInts(benchmark::State& state) {
+    std::string str;
+    for (int64_t i = 0; i < state.range(0); i++)
+        str += (i ? "," : "") + std::to_string(i * 7919);
+    FlagImpl<std::vector<int>> flag(std::vector<int>{});
+    for (auto _ : state) {
+        flag.reset();
+        benchmark::DoNotOptimize(flag.trySet(str));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * str.size());
+}
+BENCHMARK(BM_ListFlagSetInts)->Arg(100)->Arg(100000)->Unit(benchmark::kMicrosecond);
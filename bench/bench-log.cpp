@@ -0,0 +1,35 @@
+#include <string>
+
+#include <fcntl.h>
+#include <benchmark/benchmark.h>
+#include <log.hpp>
+
+using namespace pnt_cli::logging;
+
+static const std::string flagName = "some_missing_flag";
+
+// Caller side cost of a log record, written to /dev/null in the background
+static void BM_AsyncLog(benchmark::State& state) {
+    int fd = ::open("/dev/null", O_WRONLY);
+    {
+        AsyncLogger logger(fd, fd);
+        for (auto _ : state)
+            logger.log(AsyncLogger::Stream::out, "LOG", "Tried to set non existent flag: ", flagName);
+        logger.flush();
+    }
+    ::close(fd);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AsyncLog);
+
+// What log_m did on the calling thread before
+static void BM_SyncLog(benchmark::State& state) {
+    int fd = ::open("/dev/null", O_WRONLY);
+    for (auto _ : state) {
+        std::string msg = format_log(preamble("LOG"), "Tried to set non existent flag: " + flagName);
+        benchmark::DoNotOptimize(::write(fd, msg.data(), msg.size()));
+    }
+    ::close(fd);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SyncLog);
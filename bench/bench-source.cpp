@@ -0,0 +1,66 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <source.hpp>
+
+using namespace pnt_cli;
+
+static auto noopAction = [] (Command const&, Args) { return 0; };
+
+// A section per subcommand, each setting a few thousand flags
+static void BM_ApplyConfigFile(benchmark::State& state) {
+    const int64_t sections = 8, keys = state.range(0) / sections;
+    auto root = makeCommand("root", "root command", noopAction);
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-bench-" + std::to_string(::getpid()) + ".ini")).string();
+    {
+        std::ofstream file(path);
+        for (int64_t s = 0; s < sections; s++) {
+            auto sub = root->addSubcommand("section_" + std::to_string(s), "sub command", noopAction);
+            file << "[section_" << s << "]\n";
+            for (int64_t k = 0; k < keys; k++) {
+                std::string name = "some_flag_" + std::to_string(k);
+                if (k % 2) {
+                    sub->addLocalFlag<int>(name, "some description", 0);
+                    file << name << " = " << k * 7919 << "  # a comment\n";
+                } else {
+                    sub->addLocalFlag<std::string>(name, "some description", "");
+                    file << name << " = \"some/path/" << k << "\"\n";
+                }
+            }
+        }
+    }
+    root->finalize();
+    ConfigFile config(path);
+    for (auto _ : state)
+        config.apply(*root);
+    state.SetItemsProcessed(state.iterations() * sections * keys);
+    state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(path));
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_ApplyConfigFile)->Arg(1000)->Arg(40000);
+
+// Hundreds of flags against an environment of hundreds of variables, a tenth of them bound
+static void BM_ApplyEnv(benchmark::State& state) {
+    auto root = makeCommand("root", "root command", noopAction);
+    for (int s = 0; s < 10; s++) {
+        auto sub = root->addSubcommand("section_" + std::to_string(s), "sub command", noopAction);
+        for (int k = 0; k < state.range(0) / 10; k++)
+            sub->addLocalFlag<int>("some-flag-" + std::to_string(k), "some description", 0);
+    }
+    EnvSource source("APP");
+    std::vector<std::string> vars;
+    for (int i = 0; i < state.range(0); i++)
+        vars.push_back(i % 10 ? "SOME_OTHER_VARIABLE_" + std::to_string(i) + "=value"
+            : source.variableName("section_" + std::to_string(i % 100 / 10), "some-flag-" + std::to_string(i / 100)) + "=1");
+    std::vector<char*> env;
+    for (auto& var : vars) env.push_back(var.data());
+    env.push_back(nullptr);
+    for (auto _ : state)
+        source.apply(*root, env.data());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ApplyEnv)->Arg(100)->Arg(1000);
@@ -0,0 +1,257 @@
+/**
+ * @file batch.hpp
+ * @author Zografos Orfeas
+ * @brief Batch mode, dispatching many command lines to a tree built once per process.
+ * @version 0.1
+ * @date 2022-04-24
+ */
+
+#ifndef BATCH_HPP_
+#define BATCH_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <utils.hpp>
+#include <parser.hpp>
+#include <result.hpp>
+#include <command.hpp>
+#include <config.hpp>
+
+//!Note: Each command line is split into args like a response file (whitespace separated, quotes group)
+//!Note: and executed as `argv[0] <args...>` through Command::tryExecute, `@file` args included.
+//!Note: Before each line, and once the input ends, the flags the previous line could have set are restored
+//!Note: to their values when the runner was constructed (ConfigSnapshot::restoreParsed), since std::string_view
+//!Note: flag values point into the input buffer. Construct the runner after applying any ConfigFile or
+//!Note: EnvSource, so that every line starts from default < file < env and its args take precedence.
+//!Note: The exit status of each line is written after it is dispatched, followed by the delimiter:
+//!Note: the action's return value, or for lines that fail to parse 'e' and the ErrorCode's value
+//!Note: (e.g. "e2" for unknown_flag), which no return value reads as. The error is written to error_fd.
+//!Note: Empty lines are skipped without a status. Exceptions raised by actions propagate as from execute.
+//!Note:     auto root = build_tree();
+//!Note:     if (argc > 1 && std::string_view(argv[1]) == "--batch")
+//!Note:         return BatchRunner(*root, {.status_fd = STDOUT_FILENO}).run().has_value() ? 0 : 1;
+
+namespace pnt_cli {
+    namespace detail {
+        /**
+         * @brief utils::write_all for a socket whose peer may be gone, failing with EPIPE
+         * instead of raising SIGPIPE.
+         */
+        inline bool send_all(int fd, std::string_view data) {
+#ifdef MSG_NOSIGNAL
+            constexpr int flags = MSG_NOSIGNAL;
+#else
+            // SO_NOSIGPIPE is set on the socket instead (macOS, BSD)
+            constexpr int flags = 0;
+#endif
+            while (!data.empty()) {
+                ssize_t sent = ::send(fd, data.data(), data.size(), flags);
+                if (sent < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                data.remove_prefix(sent);
+            }
+            return true;
+        }
+    } // namespace detail
+
+    struct BatchOptions {
+        // separates command lines, '\n' or '\0'
+        char delimiter = '\n';
+        // where run writes the exit status of each line, -1 for nowhere (serve replies on the connection)
+        int status_fd = -1;
+        // where the errors of lines that fail to parse are written, -1 for nowhere
+        int error_fd = STDERR_FILENO;
+    };
+
+    /**
+     * @brief Reads command lines from a file descriptor or the connections to a Unix socket and
+     * dispatches each to a command tree. Buffers are reused across lines, so that a line allocates
+     * no more than executing its args would.
+     */
+    class BatchRunner {
+        private:
+            Command& root_;
+            BatchOptions options_;
+            // the flags as each line starts, lazy subcommands left unexpanded
+            ConfigSnapshot baseline_;
+            // unread input, lines are tokenized in place
+            std::string buffer_;
+            std::vector<char*> argv_;
+            std::string arg0_;
+
+            /**
+             * @brief Dispatches the lines read from `in_fd` until its end, writing statuses to `status_fd`,
+             * a socket if `status_socket`.
+             *
+             * @return the errno of a failed read, 0 on end of input
+             */
+            int run_lines(int in_fd, int status_fd, bool status_socket = false);
+            /**
+             * @brief Tokenizes the NUL terminated `line` in place and executes it.
+             *
+             * @return the action's return value or the parse error, nullopt for an empty line
+             */
+            std::optional<Result<int>> execute_line(char* line, size_t size);
+        public:
+            /**
+             * @param root root of the tree, must outlive the runner. Its flag values at construction
+             * are those every line starts from.
+             */
+            explicit BatchRunner(Command& root, BatchOptions options = {})
+                : root_(root), options_(options), baseline_(root, false), arg0_(root.path()) {}
+
+            /**
+             * @brief Dispatches the command lines read from `fd` until its end.
+             */
+            Result<void> run(int fd = STDIN_FILENO);
+            /**
+             * @brief Listens on a Unix socket at `path` (replacing any file there), dispatching the command
+             * lines of each connection in turn and replying with their statuses on the connection.
+             * The socket file is removed when serving stops. Replies to a client that has disconnected
+             * are dropped, without SIGPIPE.
+             *!Note actions write to the server's stdout, as in run
+             *
+             * @param max_connections connections to serve before returning, 0 for no limit
+             */
+            Result<void> serve(const std::string& path, size_t max_connections = 0);
+    };
+
+    inline Result<void> BatchRunner::run(int fd) {
+        if (int err = run_lines(fd, options_.status_fd))
+            return Error{ErrorCode::file_error, -1, "", std::strerror(err)};
+        return {};
+    }
+    inline Result<void> BatchRunner::serve(const std::string& path, size_t max_connections) {
+        // `err` is taken before any cleanup can overwrite errno
+        auto fail = [&path] (int listener, int err) -> Error {
+            Error error{ErrorCode::file_error, -1, path, std::strerror(err)};
+            if (listener >= 0) ::close(listener);
+            return error;
+        };
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            return Error{ErrorCode::file_error, -1, path, std::strerror(ENAMETOOLONG)};
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        // SOCK_CLOEXEC and accept4 are Linux only
+        auto set_cloexec = [] (int fd) { return ::fcntl(fd, F_SETFD, FD_CLOEXEC) == 0; };
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) return fail(listener, errno);
+        if (!set_cloexec(listener)) return fail(listener, errno);
+        ::unlink(path.c_str());
+        if (::bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(listener, SOMAXCONN) < 0)
+            return fail(listener, errno);
+        for (size_t served = 0; max_connections == 0 || served < max_connections; ) {
+            int conn = ::accept(listener, nullptr, nullptr);
+            if (conn < 0) {
+                int err = errno;
+                if (err == EINTR || err == ECONNABORTED) continue;
+                ::unlink(path.c_str());
+                return fail(listener, err);
+            }
+            if (!set_cloexec(conn)) {
+                ::close(conn);
+                continue;
+            }
+#ifdef SO_NOSIGPIPE
+            int on = 1;
+            ::setsockopt(conn, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            // a connection failing only ends that connection, a client gone before its replies only loses them
+            (void)run_lines(conn, conn, true);
+            ::close(conn);
+            served++;
+        }
+        ::close(listener);
+        ::unlink(path.c_str());
+        return {};
+    }
+    inline int BatchRunner::run_lines(int in_fd, int status_fd, bool status_socket) {
+        constexpr size_t chunk = 64 * 1024;
+        // bytes of buffer_ holding input, the rest is room to read into
+        size_t used = 0;
+        // start of the first line not dispatched, and how far the delimiter has been searched for
+        size_t start = 0, scanned = 0;
+        auto dispatch = [this, status_fd, status_socket] (size_t begin, size_t end) {
+            buffer_[end] = '\0';
+            auto status = execute_line(buffer_.data() + begin, end - begin);
+            if (!status) return;
+            if (!*status && options_.error_fd >= 0)
+                utils::write_all(options_.error_fd, status->error().message() + '\n');
+            if (status_fd >= 0) {
+                char reply[16];
+                char* out = reply;
+                if (*status) {
+                    out = std::to_chars(out, reply + sizeof(reply) - 1, **status).ptr;
+                } else {
+                    *out++ = 'e';
+                    out = std::to_chars(out, reply + sizeof(reply) - 1, static_cast<int>(status->error().code)).ptr;
+                }
+                *out++ = options_.delimiter;
+                std::string_view status_line(reply, out - reply);
+                if (status_socket) detail::send_all(status_fd, status_line);
+                else utils::write_all(status_fd, status_line);
+            }
+        };
+        while (true) {
+            // room for a read and the terminator of a last line without a delimiter
+            if (buffer_.size() < used + chunk + 1)
+                buffer_.resize(std::max(2 * buffer_.size(), used + chunk + 1));
+            ssize_t got = ::read(in_fd, buffer_.data() + used, chunk);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                int err = got < 0 ? errno : 0;
+                if (got == 0 && start < used)
+                    dispatch(start, used);
+                baseline_.restoreParsed(root_);
+                return err;
+            }
+            used += got;
+            while (const void* found = std::memchr(buffer_.data() + scanned, options_.delimiter, used - scanned)) {
+                size_t end = static_cast<const char*>(found) - buffer_.data();
+                dispatch(start, end);
+                start = scanned = end + 1;
+            }
+            // keep the partial line at the front
+            std::memmove(buffer_.data(), buffer_.data() + start, used - start);
+            used -= start;
+            scanned = used;
+            start = 0;
+        }
+    }
+    inline std::optional<Result<int>> BatchRunner::execute_line(char* line, size_t size) {
+        argv_.clear();
+        argv_.push_back(arg0_.data());
+        std::string_view text(line, size);
+        while (auto token = detail::next_token(text)) {
+            if (token->unterminated)
+                return Error{ErrorCode::unterminated_quote, static_cast<int>(argv_.size()), std::string(token->raw.substr(0, 32))};
+            // the line is ours to terminate tokens in, past their value is either a closing quote,
+            // whitespace (not part of the next token) or the line's own terminator
+            char* value = line + (token->value.data() - line);
+            value[token->value.size()] = '\0';
+            if (!text.empty() && text.data() == value + token->value.size())
+                text.remove_prefix(1);
+            argv_.push_back(value);
+        }
+        if (argv_.size() == 1) return std::nullopt;
+        baseline_.restoreParsed(root_);
+        return root_.tryExecute(static_cast<int>(argv_.size()), argv_.data());
+    }
+} // namespace pnt_cli
+
+#endif // BATCH_HPP_
@@ -10,10 +10,12 @@
 #define COMMAND_HPP_
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <algorithm>
 #include <stdexcept>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <functional>
 #include <concepts>
@@ -21,10 +23,76 @@
 
 
 #include <flag.hpp>
+#include <parser.hpp>
+#include <result.hpp>
+#include <completion.hpp>
+
+namespace pnt_cli::detail {
+    /**
+     * @brief Appends `text` word wrapped to `width` columns, lines after the first indented by `indent`
+     * (the first is assumed to start there), with a trailing newline.
+     */
+    inline void append_wrapped(std::string& out, std::string_view text, size_t indent, size_t width) {
+        const size_t avail = width > indent + 20 ? width - indent : 20;
+        size_t column = 0;
+        while (!text.empty()) {
+            size_t word_end = std::min(text.find(' '), text.size());
+            std::string_view word = text.substr(0, word_end);
+            text.remove_prefix(std::min(word_end + 1, text.size()));
+            if (word.empty()) continue;
+            if (column && column + 1 + word.size() > avail) {
+                out += '\n';
+                out.append(indent, ' ');
+                column = 0;
+            }
+            if (column) {
+                out += ' ';
+                column++;
+            }
+            out += word;
+            column += word.size();
+        }
+        out += '\n';
+    }
+    struct HelpRow {
+        std::string left;
+        std::string right;
+    };
+    /**
+     * @brief Appends rows as two columns, the right one word wrapped. Left cells too wide for the
+     * column get the right cell on the next line.
+     */
+    inline void append_table(std::string& out, const std::vector<HelpRow>& rows, size_t width) {
+        constexpr size_t margin = 2, gap = 3;
+        size_t column = 0;
+        for (const auto& row : rows)
+            column = std::max(column, row.left.size());
+        column = std::min(column, width / 2) + margin + gap;
+        for (const auto& row : rows) {
+            out.append(margin, ' ');
+            out += row.left;
+            if (margin + row.left.size() + gap > column) {
+                out += '\n';
+                out.append(column, ' ');
+            } else {
+                out.append(column - margin - row.left.size(), ' ');
+            }
+            detail::append_wrapped(out, row.right, column, width);
+        }
+    }
+} // namespace pnt_cli::detail
 
 namespace pnt_cli {
     class Command;
-    using Action = std::function<int(Command const&, std::vector<std::string>)>;
+    class CommandArena;
+    class ConfigSnapshot;
+    class ConfigFile;
+    class EnvSource;
+    using Action = std::function<int(Command const&, Args)>;
+    /**
+     * @brief Builds a lazily registered subcommand: adds its flags and subcommands and returns its action.
+     */
+    using Factory = std::function<Action(Command&)>;
 
     inline std::shared_ptr<Command> makeCommand(
         const std::string& name,
@@ -32,60 +100,225 @@ namespace pnt_cli {
         Action action
     );
 
-    class Command : public std::enable_shared_from_this<Command> {
+    /**
+     * @brief Owns a command tree: commands and their flags are allocated contiguously from
+     * a monotonic buffer and all released in one step when the arena dies.
+     * The arena only grows: storage outgrown by a command's flag sets and subcommand list is not
+     * reused (growth is geometric, so at most about as much again). Tables rebuilt after the tree
+     * changes (resolved flag tables, subcommand indexes) are allocated from the default resource.
+     * Shared pointers to commands handed out by the library alias the arena that owns them,
+     * so holding any command of a tree keeps the whole tree alive.
+     */
+    class CommandArena : public std::enable_shared_from_this<CommandArena> {
+        private:
+            std::pmr::monotonic_buffer_resource resource_;
+            std::vector<Command*> commands_;
+            // trees built by separate makeCommand calls and attached to this one through addSubcommand
+            std::vector<std::shared_ptr<CommandArena>> adopted_;
+            std::vector<Command*> adopted_roots_;
+        public:
+            CommandArena() = default;
+            ~CommandArena();
+
+            std::pmr::memory_resource* resource();
+            /**
+             * @brief Allocates a new parentless command in the arena.
+             */
+            Command* create(const std::string&, const std::string&, Action);
+            /**
+             * @brief Returns a shared pointer to a command of this arena that keeps the arena alive.
+             */
+            std::shared_ptr<Command> share(Command*);
+            /**
+             * @brief Keeps the arena owning `root` alive for as long as this one is, detaching
+             * `root` from its parent here once this arena is released.
+             */
+            void adopt(std::shared_ptr<CommandArena>, Command*);
+            size_t size() const;
+
+            CommandArena(CommandArena const&) = delete;
+            CommandArena& operator=(CommandArena const&) = delete;
+    };
+
+    /**
+     * @brief Non-owning lookup index over the names and aliases of subcommands, sorted by name.
+     * Resolves exact names and, optionally, unambiguous prefixes with binary searches.
+     */
+    class SubcommandIndex {
+        private:
+            struct Entry {
+                std::string_view name;
+                Command* command;
+            };
+            std::pmr::vector<Entry> entries_;
+            // one past the last of the consecutive entries of the same command, per entry,
+            // computed on the first prefix lookup after a change
+            mutable std::pmr::vector<std::uint32_t> run_ends_;
+            mutable bool run_ends_valid_ = false;
+
+            void compute_run_ends() const;
+        public:
+            explicit SubcommandIndex(std::pmr::memory_resource* resource = std::pmr::new_delete_resource())
+                : entries_(resource), run_ends_(resource) {}
+
+            bool empty() const;
+            size_t size() const;
+            /**
+             * @brief Rebuilds the index over the names and aliases of the given commands.
+             * The commands must outlive the index.
+             */
+            void assign(std::span<Command* const>);
+            /**
+             * @brief Adds the name and aliases of a command, keeping the index sorted.
+             * The command must outlive the index.
+             */
+            void insert(Command*);
+            /**
+             * @brief Looks up a name or alias, or if `prefix` is set a prefix of names and aliases
+             * all belonging to a single command.
+             * 
+             * @return Command* to the command if found, nullptr if not found or ambiguous
+             */
+            Command* find(std::string_view, bool prefix = false) const;
+    };
+
+    class Command {
         private:
+            friend class CommandArena;
+            friend class SubcommandIndex;
+            friend class ConfigSnapshot;
+            friend class ConfigFile;
+            friend class EnvSource;
+
+            CommandArena* arena_;
             std::string name_;
             std::string description_;
             Action action_;
+            // builds the flags, subcommands and action of a lazily registered command, run once before any of them is used
+            mutable Factory factory_;
             FlagSet persistent_flags_;
             FlagSet local_flags_;
-            std::map<std::string, std::shared_ptr<Command>> subcommands_;
-            std::shared_ptr<Command> parent_;
+            std::vector<std::string> aliases_;
+            // in order of addition
+            std::pmr::vector<Command*> subcommands_;
+            // rebuilt when subcommands are added after a lookup, not allocated from the arena either
+            mutable SubcommandIndex subcommand_index_;
+            mutable bool subcommand_index_valid_ = true;
+            bool prefix_matching_ = false;
+            Command* parent_ = nullptr;
+            // Resolved flag tables, pointing into the FlagSets of this command and its ancestors:
+            // persistent flags visible here (inherited by subcommands) and all flags visible here.
+            // Rebuilt whenever the tree changes, so not allocated from the arena
+            mutable FlagIndex inherited_flags_;
+            mutable FlagIndex visible_flags_;
+            mutable bool flag_tables_valid_ = false;
+            // rendered on first request, for the terminal width in help_width_ (0 if stale)
+            mutable std::string help_;
+            mutable int help_width_ = 0;
+            // where __complete saves the completion index of the tree, if anywhere
+            std::string completion_cache_;
+            std::string completion_version_;
+            // response files and positional runs of the last parse (of the root), which std::string_view
+            // flag values and Args point into
+            detail::ArgStore store_;
+            // command the last parse (of the root) reached, nullptr once reset
+            Command* parsed_ = nullptr;
             
             Command() = delete;
-            Command(const std::string& name, const std::string& description, Action action) 
-                : name_(name), description_(description), action_(action) {}
-            int invoke(const std::vector<std::string>&);
+            Command(CommandArena* arena, const std::string& name, const std::string& description, Action action) 
+                : arena_(arena), name_(name), description_(description), action_(action),
+                  persistent_flags_(arena->resource()), local_flags_(arena->resource()),
+                  subcommands_(arena->resource()) {}
+            bool isAncestorOf(const Command*) const;
+            /**
+             * @brief Runs the factory of a lazily registered command, if not run yet.
+             */
+            void expand() const;
 
             // Member functions for Flag searching
 
             template<FlagType T>
-            void addFlagToSet(FlagSet&, const std::string&, const std::string&, T, const std::string&);
+            Result<FlagHandle<T>> tryAddFlagToSet(FlagSet&, const std::string&, const std::string&, T, const std::string&);
 
-            Flag* find_persistent_flag_simple(std::string const&) const;
-            Flag* find_flag_simple(std::string const&) const;
+            /**
+             * @brief Marks the resolved flag tables of this command, and optionally of all
+             * its descendants, for rebuilding on next lookup.
+             */
+            void invalidate_flag_tables(bool recursive);
+            /**
+             * @brief Rebuilds the resolved flag tables if stale, from the parent's (rebuilt first
+             * if stale as well) and this command's own FlagSets.
+             */
+            void ensure_flag_tables() const;
+
+            FlagRef find_persistent_flag_simple(std::string_view) const;
+            FlagRef find_flag_simple(std::string_view) const;
+            /**
+             * @brief find_flag_simple through this command's FlagSets and its ancestors' persistent ones,
+             * without building the resolved tables, for checking new flags for conflicts.
+             */
+            FlagRef find_flag_unresolved(std::string_view) const;
             template<FlagType T>
-            FlagImpl<T>* find_persistent_flag(std::string const&) const;
+            FlagRef find_persistent_flag(std::string_view) const;
             template<FlagType T> 
-            FlagImpl<T>* find_flag(std::string const&) const;
+            FlagRef find_flag(std::string_view) const;
 
             // Member functions for executing
             /**
-             * @brief Searches for a subcommand name in the args provided
+             * @brief Looks up a direct subcommand by name or alias, or unambiguous prefix of them if `prefix` is set
              * 
-             * @return const iterator to the first arg in the vector that is a subcommand, or args.end()
+             * @return Command* to the subcommand if found, nullptr otherwise
              */
-            std::vector<std::string>::const_iterator 
-                find_first_subcommand(const std::vector<std::string>&) const;
+            Command* find_subcommand(std::string_view, bool prefix = false) const;
+            /**
+             * @brief Throws if the name is taken by a subcommand or alias of a subcommand.
+             */
+            void check_subcommand_name(std::string_view) const;
+            void link_subcommand(Command*);
+            std::string render_help(int width) const;
+            std::uint32_t index_completion(CompletionIndex::Builder&) const;
+            int complete(int argc, char** argv) const;
             
-            //!Note is meant to be called from root downwards, so only checks for flags in the current command
-            //!Note due to above behaviour, local flags that appear in two commands will be consumed by the one higher in the tree
-            // TODO: possibly would be better to prohibit subcommands from having local flags with the same name as commands higher in the tree
             /**
-             * @brief parses the args to consume flags that are visible to this command
+             * @brief Adapts the command tree to detail::try_parse_argv, tracking the command reached so far.
              */
-            void consume_flags(std::vector<std::string>&);
+            struct Dispatcher {
+                Command* cmd;
+                bool prefix_matching;
+                // set by --help/-h unless the tree defines them
+                bool help = false;
+                struct Lookup {
+                    FlagRef flag;
+                    bool is_help;
+                    explicit operator bool() const { return flag || is_help; }
+                };
+                Lookup find_flag(std::string_view name) const {
+                    FlagRef flag = cmd->find_flag_simple(name);
+                    return {flag, !flag && (name == "help" || name == "h")};
+                }
+                bool is_bool(const Lookup& found) const { return found.is_help || found.flag.typeMatches<bool>(); }
+                ConversionError set(const Lookup& found, std::string_view value) {
+                    return found.is_help ? tryFromString<bool>(value, help) : found.flag.trySet(value);
+                }
+                bool enter(std::string_view name) {
+                    Command* sub = cmd->find_subcommand(name, prefix_matching);
+                    if (sub) {
+                        sub->expand();
+                        cmd = sub;
+                    }
+                    return sub;
+                }
+            };
 
         public:
-            // This is the only way to create a Command.
+            // This is the only way to create a root Command, which owns a new CommandArena.
             friend std::shared_ptr<Command> makeCommand(
                 const std::string& name,
                 const std::string& description,
                 Action action
             ) {
-                return std::shared_ptr<Command>(
-                    new Command(name, description, action)
-                );
+                auto arena = std::make_shared<CommandArena>();
+                return arena->share(arena->create(name, description, action));
             }            
 
             ~Command() = default;
@@ -96,80 +329,403 @@ namespace pnt_cli {
 
             std::shared_ptr<Command> addSubcommand(const std::string&, const std::string&, Action);
             std::shared_ptr<Command> addSubcommand(std::shared_ptr<Command>);
+            /**
+             * @brief Registers a subcommand by name and description only. `factory` builds the rest the
+             * first time the subcommand is dispatched to, or its flags, subcommands or help are needed.
+             *!Note finalize (and completion) build the whole subtree
+             */
+            std::shared_ptr<Command> addLazySubcommand(const std::string&, const std::string&, Factory);
+            /**
+             * @brief Adds another name this command can be dispatched to by its parent.
+             */
+            void addAlias(const std::string&);
+            /**
+             * @brief Lets execute (called on the root) dispatch to subcommands by any unambiguous
+             * prefix of their names or aliases, e.g. `tool st` for `tool status`.
+             */
+            void setPrefixMatching(bool = true);
+
+            /**
+             * @brief Eagerly builds the resolved flag tables of this command and its subtree, so that any
+             * visible flag is found with a single lookup regardless of depth.
+             * Tables (and subcommand indexes) are otherwise built lazily on first lookup, and rebuilt
+             * after the tree changes.
+             *!Note call before looking flags up or parsing from multiple threads
+             */
+            void finalize();
+            /**
+             * @brief Resets every flag of this command and its subtree to its default value.
+             */
+            void reset();
+            /**
+             * @brief Resets the flags the last parse of the tree could have set, those of the commands
+             * from the root to the one it reached, in time independent of the size of the tree.
+             *!Note flags set otherwise (setFlag) are not reset
+             */
+            void resetParsed();
+            /**
+             * @brief Converts at once every flag value of this command and its subtree whose conversion
+             * was deferred to its first read (see FlagImpl), raising the first conversion error.
+             * For strict mode, call after parse and before reading any flag.
+             */
+            void validate() const;
+
+            /**
+             * @brief Usage, subcommands and flags of this command, word wrapped to `width` columns.
+             * Rendered on first request and cached until the tree changes.
+             * 
+             * @param width columns to wrap at, 0 for the width of the terminal on stdout
+             */
+            const std::string& help(int width = 0) const;
+            /**
+             * @brief Writes help for the width of the terminal `fd` is connected to, with a single write.
+             *!Note execute does so for the command reached when given --help or -h, unless they are defined as flags.
+             */
+            void printHelp(int fd = STDOUT_FILENO) const;
+
+            /**
+             * @brief Flattens the names, aliases and visible flags of this command's subtree for completion.
+             */
+            CompletionIndex completionIndex() const;
+            /**
+             * @brief Has completion requests handled by execute save the completion index to `path`,
+             * for completeFromCache to answer later requests without building the tree.
+             * 
+             * @param version identifies the tree, e.g. the program's version
+             */
+            void setCompletionCache(const std::string& path, std::string_view version = "");
 
             template<FlagType T>
-            std::optional<T> getFlag(const std::string&) const;
+            std::optional<T> getFlag(std::string_view) const;
+            /**
+             * @brief Like getFlag, without copying the value.
+             * 
+             * @return const T* to the value if found and of type `T`, nullptr otherwise.
+             * Values of built-in types move when a flag of the same type is added to the flag's command.
+             */
+            template<FlagType T>
+            const T* getFlagIf(std::string_view) const;
 
             template<FlagType T>
-            bool setFlag(const std::string&, const std::string&);
+            bool setFlag(std::string_view, const std::string&);
 
+            /**
+             * @brief Adds a flag inherited by the whole subtree.
+             * 
+             * @return a handle reading the flag's value without looking it up
+             */
             template<FlagType T>
-            void addPersistentFlag(const std::string&, const std::string&, T, const std::string& = "");
+            FlagHandle<T> addPersistentFlag(const std::string&, const std::string&, T, const std::string& = "");
 
             template<FlagType T>
-            void addLocalFlag(const std::string&, const std::string&, T, const std::string& = "");
+            FlagHandle<T> addLocalFlag(const std::string&, const std::string&, T, const std::string& = "");
+
+            // Exception-free counterparts of the functions above and below, reporting errors as values
+
+            template<FlagType T>
+            Result<FlagHandle<T>> tryAddPersistentFlag(const std::string&, const std::string&, T, const std::string& = "");
+            template<FlagType T>
+            Result<FlagHandle<T>> tryAddLocalFlag(const std::string&, const std::string&, T, const std::string& = "");
+            /**
+             * @brief execute without raising parse errors, or the error of a command reached without an action.
+             * The action itself is invoked as is.
+             */
+            Result<int> tryExecute(int, char**);
+            /**
+             * @brief parse without raising errors.
+             */
+            Result<Command*> tryParse(int, char**);
+            /**
+             * @brief validate without raising the errors of conversions reporting them through tryFromString.
+             */
+            Result<void> tryValidate() const;
+            /**
+             * @brief The names of the commands from the root to this one, space separated.
+             */
+            std::string path() const;
 
             Command(Command const&) = delete;             // Copy construct
             Command(Command&&) = delete;                  // Move construct
             Command& operator=(Command const&) = delete;  // Copy assign
             Command& operator=(Command &&) = delete;      // Move assign
 
+            /**
+             * @brief Parses argv in a single pass, dispatching down the subcommand tree, and invokes
+             * the action of the command reached with the remaining positional args.
+             * Flags are accepted anywhere, `--` ends flag parsing. Subcommands are only recognized
+             * before the first positional arg.
+             *!Note positional args are compacted in place at the front of argv (after argv[0]).
+             *!Note `argv[0] __complete <words...>` prints completion candidates instead, see completion.hpp
+             * 
+             * @return the return value of the invoked action
+             */
             int execute(int, char**);
+            /**
+             * @brief Parses argv like execute, setting flags without invoking any action.
+             *!Note std::string_view flag values from response files stay valid until the tree is parsed again.
+             * 
+             * @return the command reached
+             */
+            Command& parse(int, char**);
     };
-    inline Flag* Command::find_persistent_flag_simple(std::string const& name) const {
-        if (auto flag = persistent_flags_.find_simple(name))
-            return flag;
+    inline void Command::invalidate_flag_tables(bool recursive) {
+        flag_tables_valid_ = false;
+        help_width_ = 0;
+        if (recursive)
+            for (Command* sub : subcommands_)
+                sub->invalidate_flag_tables(true);
+    }
+    inline void Command::expand() const {
+        if (!factory_) return;
+        // cleared first, the factory adding flags looks them up through this command
+        Factory factory = std::move(factory_);
+        factory_ = nullptr;
+        // lazily registered commands are never const objects, they live in the arena
+        Command& self = const_cast<Command&>(*this);
+        self.action_ = factory(self);
+        help_width_ = 0;
+    }
+    inline void Command::ensure_flag_tables() const {
+        if (flag_tables_valid_) return;
+        expand();
+        if (hasParent()) parent_->ensure_flag_tables();
+        // own persistent flags shadow the ones inherited from the nearest ancestor, local flags shadow both
+        std::vector<FlagRef> inherited(persistent_flags_.index().begin(), persistent_flags_.index().end());
         if (hasParent())
-            return parent_->find_persistent_flag_simple(name);
-        return nullptr;
+            inherited.insert(inherited.end(), parent_->inherited_flags_.begin(), parent_->inherited_flags_.end());
+        inherited_flags_.assign(inherited);
+        std::vector<FlagRef> visible;
+        visible.reserve(local_flags_.size() + inherited.size());
+        visible.insert(visible.end(), local_flags_.index().begin(), local_flags_.index().end());
+        visible.insert(visible.end(), inherited.begin(), inherited.end());
+        visible_flags_.assign(visible);
+        flag_tables_valid_ = true;
+    }
+    inline void Command::reset() {
+        persistent_flags_.reset();
+        local_flags_.reset();
+        for (Command* sub : subcommands_)
+            sub->reset();
+    }
+    inline void Command::resetParsed() {
+        if (hasParent()) return parent_->resetParsed();
+        for (Command* cmd = parsed_; cmd; cmd = cmd->parent_) {
+            cmd->persistent_flags_.reset();
+            cmd->local_flags_.reset();
+        }
+        parsed_ = nullptr;
     }
-    inline Flag* Command::find_flag_simple(std::string const& name) const {
-        if (auto flag = local_flags_.find_simple(name))
+    inline void Command::validate() const {
+        tryValidate().value();
+    }
+    inline Result<void> Command::tryValidate() const {
+        for (const FlagSet* set : {&persistent_flags_, &local_flags_}) {
+            ConversionError err;
+            if (FlagRef flag = set->validate(&err)) {
+                auto code = err == ConversionError::out_of_range ? ErrorCode::out_of_range : ErrorCode::invalid_value;
+                return Error{code, -1, "--" + flag.name(), std::string(flag.pendingValue()), path()};
+            }
+        }
+        // unexpanded lazy subcommands have no flags set
+        for (const Command* sub : subcommands_)
+            if (auto res = sub->tryValidate(); !res)
+                return res;
+        return {};
+    }
+    inline void Command::finalize() {
+        ensure_flag_tables();
+        find_subcommand(name_);
+        for (Command* sub : subcommands_)
+            sub->finalize();
+    }
+    inline FlagRef Command::find_persistent_flag_simple(std::string_view name) const {
+        ensure_flag_tables();
+        return inherited_flags_.find(name);
+    }
+    inline FlagRef Command::find_flag_simple(std::string_view name) const {
+        ensure_flag_tables();
+        return visible_flags_.find(name);
+    }
+    inline FlagRef Command::find_flag_unresolved(std::string_view name) const {
+        expand();
+        if (FlagRef flag = local_flags_.find_simple(name))
             return flag;
-        return find_persistent_flag_simple(name);
+        for (const Command* cmd = this; cmd; cmd = cmd->parent_)
+            if (FlagRef flag = cmd->persistent_flags_.find_simple(name))
+                return flag;
+        return {};
     }
     template<FlagType T>
-    inline FlagImpl<T>* Command::find_persistent_flag(const std::string& name) const {
-        return find_persistent_flag_simple(name).as<T>();
+    inline FlagRef Command::find_persistent_flag(std::string_view name) const {
+        FlagRef flag = find_persistent_flag_simple(name);
+        return flag && flag.typeMatches<T>() ? flag : FlagRef();
     }
     template<FlagType T>
-    inline FlagImpl<T>* Command::find_flag(const std::string& name) const {
-        return find_flag_simple(name).as<T>();
-    };
-    inline bool Command::hasParent() const { return (bool)parent_; }
-    inline bool Command::hasSubcommands() const { return !subcommands_.empty(); }
+    inline FlagRef Command::find_flag(std::string_view name) const {
+        FlagRef flag = find_flag_simple(name);
+        return flag && flag.typeMatches<T>() ? flag : FlagRef();
+    }
+    inline bool SubcommandIndex::empty() const { return entries_.empty(); }
+    inline size_t SubcommandIndex::size() const { return entries_.size(); }
+    inline void SubcommandIndex::assign(std::span<Command* const> commands) {
+        entries_.clear();
+        for (Command* cmd : commands) {
+            entries_.push_back(Entry{cmd->name_, cmd});
+            for (const auto& alias : cmd->aliases_)
+                entries_.push_back(Entry{alias, cmd});
+        }
+        std::sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+            return a.name < b.name;
+        });
+        run_ends_valid_ = false;
+    }
+    inline void SubcommandIndex::insert(Command* cmd) {
+        auto insert_name = [this, cmd] (std::string_view name) {
+            auto pos = std::upper_bound(entries_.begin(), entries_.end(), name, [](std::string_view n, const Entry& e) {
+                return n < e.name;
+            });
+            entries_.insert(pos, Entry{name, cmd});
+        };
+        insert_name(cmd->name_);
+        for (const auto& alias : cmd->aliases_)
+            insert_name(alias);
+        run_ends_valid_ = false;
+    }
+    inline void SubcommandIndex::compute_run_ends() const {
+        run_ends_.resize(entries_.size());
+        for (size_t i = entries_.size(); i-- > 0;) {
+            bool same_as_next = i + 1 < entries_.size() && entries_[i + 1].command == entries_[i].command;
+            run_ends_[i] = same_as_next ? run_ends_[i + 1] : static_cast<std::uint32_t>(i + 1);
+        }
+        run_ends_valid_ = true;
+    }
+    inline Command* SubcommandIndex::find(std::string_view name, bool prefix) const {
+        if (name.empty()) return nullptr;
+        auto first = std::lower_bound(entries_.begin(), entries_.end(), name, [](const Entry& e, std::string_view n) {
+            return e.name < n;
+        });
+        if (first == entries_.end()) return nullptr;
+        if (first->name == name) return first->command;
+        if (!prefix || !first->name.starts_with(name)) return nullptr;
+        // entries sharing the prefix are contiguous, unambiguous if they all fall in a single run
+        auto last = std::partition_point(first, entries_.end(), [name](const Entry& e) {
+            return e.name.starts_with(name);
+        });
+        if (!run_ends_valid_) compute_run_ends();
+        return static_cast<size_t>(last - entries_.begin()) <= run_ends_[first - entries_.begin()] ? first->command : nullptr;
+    }
+
+    inline CommandArena::~CommandArena() {
+        for (Command* root : adopted_roots_) {
+            root->parent_ = nullptr;
+            root->invalidate_flag_tables(true);
+        }
+        std::for_each(commands_.rbegin(), commands_.rend(), [](Command* cmd) { std::destroy_at(cmd); });
+    }
+    inline std::pmr::memory_resource* CommandArena::resource() { return &resource_; }
+    inline Command* CommandArena::create(const std::string& name, const std::string& description, Action action) {
+        std::pmr::polymorphic_allocator<> alloc(&resource_);
+        Command* cmd = alloc.allocate_object<Command>();
+        new (cmd) Command(this, name, description, action);
+        commands_.push_back(cmd);
+        return cmd;
+    }
+    inline std::shared_ptr<Command> CommandArena::share(Command* cmd) {
+        return std::shared_ptr<Command>(shared_from_this(), cmd);
+    }
+    inline void CommandArena::adopt(std::shared_ptr<CommandArena> arena, Command* root) {
+        adopted_.push_back(std::move(arena));
+        adopted_roots_.push_back(root);
+    }
+    inline size_t CommandArena::size() const { return commands_.size(); }
+
+    inline bool Command::hasParent() const { return parent_ != nullptr; }
+    inline bool Command::hasSubcommands() const {
+        expand();
+        return !subcommands_.empty();
+    }
     inline bool Command::hasFlags() const {
+        expand();
         return !persistent_flags_.empty() ||
                 !local_flags_.empty();
     }
+    inline bool Command::isAncestorOf(const Command* cmd) const {
+        for (; cmd; cmd = cmd->parent_)
+            if (cmd == this) return true;
+        return false;
+    }
+    inline void Command::check_subcommand_name(std::string_view name) const {
+        if (find_subcommand(name))
+            utils::raise("Subcommand with name " + std::string(name) + " already exists");
+    }
+    inline void Command::link_subcommand(Command* cmd) {
+        subcommands_.push_back(cmd);
+        // registering many subcommands keeps the index sorted instead of re-sorting it on each name check
+        if (subcommand_index_valid_) subcommand_index_.insert(cmd);
+        help_width_ = 0;
+        cmd->parent_ = this;
+        cmd->invalidate_flag_tables(true);
+    }
     inline std::shared_ptr<Command> Command::addSubcommand(
         const std::string& name,
         const std::string& description,
         Action action
     ) {
-        auto cmd = makeCommand(name, description, action);
-        subcommands_[name] = cmd;
-        auto shared_this = shared_from_this();
-        cmd->parent_ = shared_this;
-        return cmd;                
+        check_subcommand_name(name);
+        Command* cmd = arena_->create(name, description, action);
+        link_subcommand(cmd);
+        return arena_->share(cmd);
+    }
+    inline std::shared_ptr<Command> Command::addLazySubcommand(
+        const std::string& name,
+        const std::string& description,
+        Factory factory
+    ) {
+        check_subcommand_name(name);
+        Command* cmd = arena_->create(name, description, nullptr);
+        cmd->factory_ = std::move(factory);
+        link_subcommand(cmd);
+        return arena_->share(cmd);
     }
     inline std::shared_ptr<Command> Command::addSubcommand(std::shared_ptr<Command> subCmd) {
-        subcommands_[subCmd->name_] = subCmd;
-        auto shared_this = shared_from_this();
-        subCmd->parent_ = shared_this;
+        if (subCmd->hasParent())
+            utils::raise("Command " + subCmd->name_ + " already has a parent");
+        if (subCmd->isAncestorOf(this))
+            utils::raise("Command " + subCmd->name_ + " cannot be its own subcommand");
+        check_subcommand_name(subCmd->name_);
+        for (const auto& alias : subCmd->aliases_)
+            check_subcommand_name(alias);
+        if (subCmd->arena_ != arena_)
+            arena_->adopt(subCmd->arena_->shared_from_this(), subCmd.get());
+        link_subcommand(subCmd.get());
         return subCmd;
-        
     }
+    inline void Command::addAlias(const std::string& alias) {
+        if (alias == name_ || std::find(aliases_.begin(), aliases_.end(), alias) != aliases_.end())
+            utils::raise("Command " + name_ + " already has alias " + alias);
+        if (hasParent()) {
+            parent_->check_subcommand_name(alias);
+            parent_->subcommand_index_valid_ = false;
+        }
+        aliases_.push_back(alias);
+        help_width_ = 0;
+    }
+    inline void Command::setPrefixMatching(bool enabled) { prefix_matching_ = enabled; }
     template<FlagType T>
-    inline std::optional<T> Command::getFlag(const std::string& name) const {
-        if (FlagImpl<T>* val = find_flag<T>(name))
-            return val->get();
+    inline std::optional<T> Command::getFlag(std::string_view name) const {
+        if (const T* val = getFlagIf<T>(name))
+            return *val;
         return std::nullopt;
     }
     template<FlagType T>
-    inline bool Command::setFlag(const std::string& name, const std::string& val) {
-        if (FlagImpl<T>* f = find_flag<T>(name)) {
-            f->set(val);
+    inline const T* Command::getFlagIf(std::string_view name) const {
+        FlagRef flag = find_flag_simple(name);
+        return flag ? flag.getIf<T>() : nullptr;
+    }
+    template<FlagType T>
+    inline bool Command::setFlag(std::string_view name, const std::string& val) {
+        if (FlagRef f = find_flag<T>(name)) {
+            f.set(val);
             return true;
         }
         return false;
@@ -178,94 +734,222 @@ namespace pnt_cli {
     //*DONE: Catch cases of flag conflicts
     //*DONE: Test cases of flag conflicts
     template<FlagType T>
-    inline void Command::addFlagToSet(
+    inline Result<FlagHandle<T>> Command::tryAddFlagToSet(
         FlagSet& set,
         const std::string& name,
         const std::string& description,
         T default_value,
         const std::string& shorthand
     ) {
-        if (find_flag<T>(name))
-            throw std::runtime_error(std::string("Flag with name ") + name + " already exists");
-        if (shorthand.length() && find_flag<T>(shorthand))
-            throw std::runtime_error(std::string("Flag with shorthand ") + shorthand + " already exists");
-        set.addFlag<T>(name, description, default_value, shorthand);
+        if (find_flag_unresolved(name))
+            return Error{ErrorCode::name_conflict, -1, name, "", path()};
+        if (shorthand.length() && find_flag_unresolved(shorthand))
+            return Error{ErrorCode::name_conflict, -1, shorthand, "", path()};
+        if (!set.addFlag<T>(name, description, default_value, shorthand))
+            return Error{ErrorCode::invalid_shorthand, -1, shorthand, name, path()};
+        // persistent flags are inherited by the whole subtree
+        invalidate_flag_tables(&set == &persistent_flags_);
+        return FlagHandle<T>(set.find_simple(name));
     }
     template<FlagType T>
-    inline void Command::addPersistentFlag(
+    inline FlagHandle<T> Command::addPersistentFlag(
         const std::string& name,
         const std::string& description,
         T default_value,
         const std::string& shorthand
     ) {
-        addFlagToSet<T>(persistent_flags_, name, description, default_value, shorthand);
+        return tryAddFlagToSet<T>(persistent_flags_, name, description, default_value, shorthand).value();
     }
     template<FlagType T>
-    inline void Command::addLocalFlag(
+    inline FlagHandle<T> Command::addLocalFlag(
         const std::string& name,
         const std::string& description,
         T default_value,
         const std::string& shorthand
     ){
-        addFlagToSet<T>(local_flags_, name, description, default_value, shorthand);
+        return tryAddFlagToSet<T>(local_flags_, name, description, default_value, shorthand).value();
     }
-    inline int Command::invoke(std::vector<std::string> const& args) {
-        return action_(*this, args);
+    template<FlagType T>
+    inline Result<FlagHandle<T>> Command::tryAddPersistentFlag(
+        const std::string& name,
+        const std::string& description,
+        T default_value,
+        const std::string& shorthand
+    ) {
+        return tryAddFlagToSet<T>(persistent_flags_, name, description, default_value, shorthand);
     }
-    inline std::vector<std::string>::const_iterator
-        Command::find_first_subcommand(std::vector<std::string> const& args) const {
-        auto iterToFound = std::find_if(args.begin(), args.end(), [this](auto const& arg) {
-            return this->subcommands_.find(arg) != this->subcommands_.end();
+    template<FlagType T>
+    inline Result<FlagHandle<T>> Command::tryAddLocalFlag(
+        const std::string& name,
+        const std::string& description,
+        T default_value,
+        const std::string& shorthand
+    ) {
+        return tryAddFlagToSet<T>(local_flags_, name, description, default_value, shorthand);
+    }
+    inline std::string Command::path() const {
+        return hasParent() ? parent_->path() + " " + name_ : name_;
+    }
+    inline Command* Command::find_subcommand(std::string_view name, bool prefix) const {
+        expand();
+        if (!subcommand_index_valid_) {
+            subcommand_index_.assign(subcommands_);
+            subcommand_index_valid_ = true;
+        }
+        return subcommand_index_.find(name, prefix);
+    }
+    inline const std::string& Command::help(int width) const {
+        if (width <= 0)
+            width = utils::terminal_width();
+        if (help_width_ != width) {
+            help_ = render_help(width);
+            help_width_ = width;
+        }
+        return help_;
+    }
+    inline void Command::printHelp(int fd) const {
+        utils::write_all(fd, help(utils::terminal_width(fd)));
+    }
+    inline std::string Command::render_help(int width) const {
+        // subcommands are listed by name and description, without building the lazily registered ones
+        ensure_flag_tables();
+        const std::string cmd_path = path();
+        std::string out;
+        if (!description_.empty()) {
+            detail::append_wrapped(out, description_, 0, width);
+            out += "\n";
+        }
+        out += "Usage:\n";
+        if (action_ || subcommands_.empty())
+            out += "  " + cmd_path + " [flags] [args]\n";
+        if (!subcommands_.empty())
+            out += "  " + cmd_path + " [command]\n";
+        if (!aliases_.empty()) {
+            out += "\nAliases:\n  " + name_;
+            for (const auto& alias : aliases_) out += ", " + alias;
+            out += "\n";
+        }
+        if (!subcommands_.empty()) {
+            std::vector<detail::HelpRow> rows;
+            rows.reserve(subcommands_.size());
+            for (const Command* sub : subcommands_)
+                rows.push_back({sub->name_, sub->description_});
+            out += "\nAvailable Commands:\n";
+            detail::append_table(out, rows, width);
+        }
+        // own flags, then persistent ones inherited from ancestors and not shadowed
+        std::vector<detail::HelpRow> own, inherited;
+        auto row = [] (FlagRef flag) {
+            std::string left = flag.shorthand().empty() ? "    " : "-" + flag.shorthand() + ", ";
+            left += "--" + flag.name();
+            if (!flag.typeMatches<bool>()) left += " " + flag.typeName();
+            std::string right = flag.description();
+            std::string def = flag.defaultString();
+            if (!def.empty() && !flag.typeMatches<bool>())
+                right += (right.empty() ? "(default " : " (default ") + def + ")";
+            return detail::HelpRow{std::move(left), std::move(right)};
+        };
+        for (const FlagSet* set : {&local_flags_, &persistent_flags_})
+            for (FlagRef flag : set->index())
+                own.push_back(row(flag));
+        if (hasParent())
+            for (FlagRef flag : parent_->inherited_flags_)
+                if (visible_flags_.find_name(flag.name()) == flag)
+                    inherited.push_back(row(flag));
+        if (!visible_flags_.find_name("help"))
+            own.push_back({visible_flags_.find_shorthand('h') ? "    --help" : "-h, --help", "help for " + name_});
+        std::sort(own.begin(), own.end(), [] (const auto& a, const auto& b) {
+            return a.left.substr(a.left.find("--")) < b.left.substr(b.left.find("--"));
         });
-        return iterToFound;
-    }
-    // TODO: capture indexes of flags, read them and remove them from args
-    inline void Command::consume_flags(std::vector<std::string>& args) {
-        // auto decider = [this](std::string const& arg) {
-        //     std::string flag_name;
-        //     if (arg[0] == '-' && arg[1] == '-') {
-        //         flag_name = arg.substr(2);
-        //         if (flag_name.length() <= 0)
-        //             throw std::runtime_error("Invalid flag name: " + arg);
-        //     } else if (arg[0] == '-') {
-        //         flag_name = arg.substr(1);
-        //         if (flag_name.length() != 1)
-        //             throw std::runtime_error("Flag shorthand must be one character: " + arg);
-        //     } else { return false; }
-        //     if (Flag* flag = this->find_flag_simple(flag_name)) {
-        //     }
-        // };
-
-        for (size_t i = 0; i < args.size(); i++) {
-            std::string flag_name;
-            std::string flag_value;
-            if (args[i][0] == '-' && args[i][1] == '-') {
-                flag_name = args[i].substr(2);
-                if (flag_name.length() <= 0)
-                    throw std::runtime_error("Invalid flag name: " + args[i]);
-            } else if (args[i][0] == '-') {
-                flag_name = args[i].substr(1);
-                if (flag_name.length() <= 0) {
-                    throw std::runtime_error("Flag shorthand must be at least one character");
-                } else if (flag_name.length() > 1) {
-                    flag_value = flag_name.substr(1);
-                    flag_name = flag_name.substr(0, 1);
-                    //!NOTE: this is were you stopped working on this.
-                }
-            } else { continue; }
-
+        out += "\nFlags:\n";
+        detail::append_table(out, own, width);
+        if (!inherited.empty()) {
+            out += "\nGlobal Flags:\n";
+            detail::append_table(out, inherited, width);
         }
+        if (!subcommands_.empty())
+            out += "\nUse \"" + cmd_path + " [command] --help\" for more information about a command.\n";
+        return out;
     }
-
-
-
-
-    inline int Command::execute(int argc, char** argv) {
-        if (!hasParent()) return parent_->execute(argc, argv);
-        std::vector<std::string> args(argv + 1, argv + argc);
-        error_m("Not implemented");
+    inline std::uint32_t Command::index_completion(CompletionIndex::Builder& builder) const {
+        ensure_flag_tables();
+        std::uint32_t node = builder.addNode();
+        std::vector<CompletionIndex::FlagInfo> flags;
+        flags.reserve(visible_flags_.size() + 1);
+        for (FlagRef flag : visible_flags_) {
+            char shorthand = flag.shorthand().empty() ? 0 : flag.shorthand()[0];
+            flags.push_back({flag.name(), shorthand, !flag.typeMatches<bool>()});
+        }
+        if (!visible_flags_.find_name("help"))
+            flags.push_back({"help", visible_flags_.find_shorthand('h') ? '\0' : 'h', false});
+        builder.setFlags(node, std::move(flags));
+        std::vector<CompletionIndex::ChildInfo> children;
+        for (const Command* sub : subcommands_) {
+            std::uint32_t child = sub->index_completion(builder);
+            children.push_back({sub->name_, child, false});
+            for (const auto& alias : sub->aliases_)
+                children.push_back({alias, child, true});
+        }
+        builder.setChildren(node, std::move(children));
+        return node;
+    }
+    inline CompletionIndex Command::completionIndex() const {
+        CompletionIndex::Builder builder;
+        index_completion(builder);
+        return std::move(builder).finish(CompletionIndex::stampOf(completion_version_), prefix_matching_);
+    }
+    inline void Command::setCompletionCache(const std::string& path, std::string_view version) {
+        completion_cache_ = path;
+        completion_version_ = version;
+    }
+    inline int Command::complete(int argc, char** argv) const {
+        CompletionIndex index = completionIndex();
+        utils::write_all(STDOUT_FILENO, index.complete(std::span<const char* const>(argv + 2, argc - 2)));
+        // best effort, a failure only costs the next request a rebuild
+        if (!completion_cache_.empty())
+            (void)index.save(completion_cache_);
         return 0;
     }
+    inline int Command::execute(int argc, char** argv) {
+        if (hasParent()) return parent_->execute(argc, argv);
+        return tryExecute(argc, argv).value();
+    }
+    inline Command& Command::parse(int argc, char** argv) {
+        if (hasParent()) return parent_->parse(argc, argv);
+        return *tryParse(argc, argv).value();
+    }
+    inline Result<int> Command::tryExecute(int argc, char** argv) {
+        if (hasParent()) return parent_->tryExecute(argc, argv);
+        if (argc > 1 && std::string_view(argv[1]) == "__complete" && !find_subcommand("__complete"))
+            return complete(argc, argv);
+        Dispatcher dispatcher{this, prefix_matching_};
+        store_.clear();
+        Error err = detail::try_parse_argv(dispatcher, argc, argv, store_);
+        parsed_ = dispatcher.cmd;
+        if (err) {
+            err.command = dispatcher.cmd->path();
+            return err;
+        }
+        if (dispatcher.help) {
+            dispatcher.cmd->printHelp();
+            return 0;
+        }
+        if (!dispatcher.cmd->action_)
+            return Error{ErrorCode::no_action, -1, "", "", dispatcher.cmd->path()};
+        return dispatcher.cmd->action_(*dispatcher.cmd, Args(store_.runs));
+    }
+    inline Result<Command*> Command::tryParse(int argc, char** argv) {
+        if (hasParent()) return parent_->tryParse(argc, argv);
+        Dispatcher dispatcher{this, prefix_matching_};
+        store_.clear();
+        Error err = detail::try_parse_argv(dispatcher, argc, argv, store_);
+        parsed_ = dispatcher.cmd;
+        if (err) {
+            err.command = dispatcher.cmd->path();
+            return err;
+        }
+        return dispatcher.cmd;
+    }
 } // namespace paint_cli
 
 #endif // COMMAND_HPP_
\ No newline at end of file
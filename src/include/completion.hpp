@@ -0,0 +1,380 @@
+/**
+ * @file completion.hpp
+ * @author Zografos Orfeas
+ * @brief Shell completion from a compact, memory mappable index of a command tree.
+ * @version 0.1
+ * @date 2022-04-22
+ */
+
+#ifndef COMPLETION_HPP_
+#define COMPLETION_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <utils.hpp>
+
+//!Note: `app __complete <words...>` prints the candidates for the last word (possibly empty), one per line:
+//!Note: subcommands while still in subcommand position, flags (`--name`, `-s`) for words starting with '-',
+//!Note: nothing for the value of a flag, leaving it to the shell.
+//!Note: Bash: _app() { mapfile -t COMPREPLY < <(app __complete "${COMP_WORDS[@]:1:COMP_CWORD}"); }; complete -F _app app
+//!Note: Completing without building the tree, from an index saved by a previous completion request:
+//!Note:     if (auto status = completeFromCache(cache_path, VERSION, argc, argv)) return *status;
+//!Note:     auto root = build_tree();
+//!Note:     root->setCompletionCache(cache_path, VERSION);    // __complete saves the index here
+//!Note:     return root->execute(argc, argv);
+
+namespace pnt_cli {
+    /**
+     * @brief Names, aliases and visible flags of every command in a tree, flattened into a single
+     * relocatable buffer that is queried in place, whether built in memory or mapped from a file.
+     */
+    class CompletionIndex {
+        private:
+            // Layout: Header, Node[node_count], Child[child_count], FlagEntry[flag_count], string pool.
+            // Node 0 is the root, children and flags of a node are contiguous and sorted by name.
+            struct Header {
+                char magic[8];
+                std::uint64_t stamp;
+                std::uint32_t prefix_matching;
+                std::uint32_t node_count;
+                std::uint32_t child_count;
+                std::uint32_t flag_count;
+                std::uint32_t strings_size;
+                std::uint32_t reserved;
+            };
+            struct Node {
+                std::uint32_t first_child, child_count;
+                std::uint32_t first_flag, flag_count;
+            };
+            struct Child {
+                std::uint32_t name_offset, name_length;
+                std::uint32_t node;
+                std::uint32_t is_alias;
+            };
+            struct FlagEntry {
+                std::uint32_t name_offset, name_length;
+                std::uint32_t shorthand;
+                std::uint32_t takes_value;
+            };
+            static constexpr char magic_[8] = {'P', 'N', 'T', 'C', 'M', 'P', '1', '\0'};
+
+            std::string owned_;
+            utils::MappedFile file_;
+
+            std::string_view bytes() const { return owned_.empty() ? file_.view() : std::string_view(owned_); }
+            const Header& header() const { return *reinterpret_cast<const Header*>(bytes().data()); }
+            const Node* nodes() const { return reinterpret_cast<const Node*>(bytes().data() + sizeof(Header)); }
+            const Child* children() const { return reinterpret_cast<const Child*>(nodes() + header().node_count); }
+            const FlagEntry* flags() const { return reinterpret_cast<const FlagEntry*>(children() + header().child_count); }
+            const char* strings() const { return reinterpret_cast<const char*>(flags() + header().flag_count); }
+            std::string_view name_at(std::uint32_t offset, std::uint32_t length) const { return {strings() + offset, length}; }
+
+            bool valid(std::uint64_t stamp) const;
+            std::span<const Child> children_of(std::uint32_t node) const;
+            std::span<const FlagEntry> flags_of(std::uint32_t node) const;
+            const Child* find_child(std::uint32_t node, std::string_view) const;
+            const FlagEntry* find_flag(std::uint32_t node, std::string_view name, char shorthand) const;
+        public:
+            struct FlagInfo {
+                std::string_view name;
+                char shorthand;
+                bool takes_value;
+            };
+            struct ChildInfo {
+                std::string_view name;
+                std::uint32_t node;
+                bool is_alias;
+            };
+            /**
+             * @brief Serializes a tree node by node, node ids being handed out in order of addNode calls.
+             * The names passed in only need to live until the next call.
+             */
+            class Builder {
+                private:
+                    std::vector<Node> nodes_;
+                    std::vector<Child> children_;
+                    std::vector<FlagEntry> flags_;
+                    std::string strings_;
+                    // pool offsets of the names added so far, persistent flags repeat in every subtree
+                    std::unordered_map<std::string, std::uint32_t> pooled_;
+
+                    std::uint32_t pool(std::string_view);
+                public:
+                    std::uint32_t addNode();
+                    void setChildren(std::uint32_t node, std::vector<ChildInfo>);
+                    void setFlags(std::uint32_t node, std::vector<FlagInfo>);
+                    /**
+                     * @param stamp hash of the version string the index is valid for, see stampOf
+                     * @param prefix_matching whether subcommands are resolved by unambiguous prefixes
+                     */
+                    CompletionIndex finish(std::uint64_t stamp, bool prefix_matching) &&;
+            };
+
+            CompletionIndex() = default;
+
+            /**
+             * @brief FNV-1a hash of a version string, identifying the tree an index was saved for.
+             */
+            static std::uint64_t stampOf(std::string_view);
+
+            /**
+             * @brief Maps an index saved by save, replacing this one on success.
+             *
+             * @return false if the file is missing, corrupt or saved for another stamp
+             */
+            bool open(const std::string& path, std::uint64_t stamp = 0) noexcept;
+            /**
+             * @brief Atomically replaces the file at `path` with this index.
+             *
+             * @return false on error
+             */
+            bool save(const std::string& path) const noexcept;
+            bool empty() const;
+            size_t size() const;
+
+            /**
+             * @brief Candidates for the last of `words`, the words following the program name.
+             *
+             * @return the candidates, each followed by a newline
+             */
+            std::string complete(std::span<const char* const> words) const;
+    };
+
+    inline std::uint32_t CompletionIndex::Builder::pool(std::string_view str) {
+        auto [it, inserted] = pooled_.try_emplace(std::string(str), static_cast<std::uint32_t>(strings_.size()));
+        if (inserted)
+            strings_ += str;
+        return it->second;
+    }
+    inline std::uint32_t CompletionIndex::Builder::addNode() {
+        nodes_.push_back(Node{0, 0, 0, 0});
+        return static_cast<std::uint32_t>(nodes_.size() - 1);
+    }
+    inline void CompletionIndex::Builder::setChildren(std::uint32_t node, std::vector<ChildInfo> children) {
+        std::sort(children.begin(), children.end(), [] (const ChildInfo& a, const ChildInfo& b) {
+            return a.name < b.name;
+        });
+        nodes_[node].first_child = static_cast<std::uint32_t>(children_.size());
+        nodes_[node].child_count = static_cast<std::uint32_t>(children.size());
+        for (const auto& child : children)
+            children_.push_back(Child{pool(child.name), static_cast<std::uint32_t>(child.name.size()),
+                child.node, child.is_alias});
+    }
+    inline void CompletionIndex::Builder::setFlags(std::uint32_t node, std::vector<FlagInfo> flags) {
+        std::sort(flags.begin(), flags.end(), [] (const FlagInfo& a, const FlagInfo& b) {
+            return a.name < b.name;
+        });
+        nodes_[node].first_flag = static_cast<std::uint32_t>(flags_.size());
+        nodes_[node].flag_count = static_cast<std::uint32_t>(flags.size());
+        for (const auto& flag : flags)
+            flags_.push_back(FlagEntry{pool(flag.name), static_cast<std::uint32_t>(flag.name.size()),
+                static_cast<unsigned char>(flag.shorthand), flag.takes_value});
+    }
+    inline CompletionIndex CompletionIndex::Builder::finish(std::uint64_t stamp, bool prefix_matching) && {
+        Header header{};
+        std::memcpy(header.magic, magic_, sizeof(magic_));
+        header.stamp = stamp;
+        header.prefix_matching = prefix_matching;
+        header.node_count = static_cast<std::uint32_t>(nodes_.size());
+        header.child_count = static_cast<std::uint32_t>(children_.size());
+        header.flag_count = static_cast<std::uint32_t>(flags_.size());
+        header.strings_size = static_cast<std::uint32_t>(strings_.size());
+
+        CompletionIndex index;
+        std::string& out = index.owned_;
+        out.reserve(sizeof(Header) + nodes_.size() * sizeof(Node) + children_.size() * sizeof(Child) +
+            flags_.size() * sizeof(FlagEntry) + strings_.size());
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.append(reinterpret_cast<const char*>(nodes_.data()), nodes_.size() * sizeof(Node));
+        out.append(reinterpret_cast<const char*>(children_.data()), children_.size() * sizeof(Child));
+        out.append(reinterpret_cast<const char*>(flags_.data()), flags_.size() * sizeof(FlagEntry));
+        out += strings_;
+        return index;
+    }
+
+    inline std::uint64_t CompletionIndex::stampOf(std::string_view version) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (char c : version) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+    inline bool CompletionIndex::valid(std::uint64_t stamp) const {
+        std::string_view data = bytes();
+        if (data.size() < sizeof(Header)) return false;
+        const Header& h = header();
+        if (std::memcmp(h.magic, magic_, sizeof(magic_)) != 0 || h.stamp != stamp || h.node_count == 0)
+            return false;
+        std::uint64_t expected = sizeof(Header) + std::uint64_t(h.node_count) * sizeof(Node) +
+            std::uint64_t(h.child_count) * sizeof(Child) + std::uint64_t(h.flag_count) * sizeof(FlagEntry) + h.strings_size;
+        if (data.size() != expected) return false;
+        // bounds are checked once here, so that queries can trust the index
+        auto in_pool = [&h] (std::uint32_t offset, std::uint32_t length) {
+            return std::uint64_t(offset) + length <= h.strings_size;
+        };
+        for (const Node& node : std::span(nodes(), h.node_count))
+            if (std::uint64_t(node.first_child) + node.child_count > h.child_count ||
+                std::uint64_t(node.first_flag) + node.flag_count > h.flag_count)
+                return false;
+        for (const Child& child : std::span(children(), h.child_count))
+            if (!in_pool(child.name_offset, child.name_length) || child.node >= h.node_count)
+                return false;
+        for (const FlagEntry& flag : std::span(flags(), h.flag_count))
+            if (!in_pool(flag.name_offset, flag.name_length))
+                return false;
+        return true;
+    }
+    inline bool CompletionIndex::open(const std::string& path, std::uint64_t stamp) noexcept {
+        CompletionIndex index;
+        if (index.file_.open(path) != 0 || !index.valid(stamp))
+            return false;
+        *this = std::move(index);
+        return true;
+    }
+    inline bool CompletionIndex::save(const std::string& path) const noexcept {
+        std::string tmp = path + "." + std::to_string(::getpid()) + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+        bool ok = utils::write_all(fd, bytes());
+        ok = ::close(fd) == 0 && ok;
+        if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+    inline bool CompletionIndex::empty() const { return bytes().empty(); }
+    inline size_t CompletionIndex::size() const { return bytes().size(); }
+
+    inline std::span<const CompletionIndex::Child> CompletionIndex::children_of(std::uint32_t node) const {
+        return {children() + nodes()[node].first_child, nodes()[node].child_count};
+    }
+    inline std::span<const CompletionIndex::FlagEntry> CompletionIndex::flags_of(std::uint32_t node) const {
+        return {flags() + nodes()[node].first_flag, nodes()[node].flag_count};
+    }
+    inline const CompletionIndex::Child* CompletionIndex::find_child(std::uint32_t node, std::string_view name) const {
+        auto entries = children_of(node);
+        auto first = std::lower_bound(entries.begin(), entries.end(), name, [this] (const Child& c, std::string_view n) {
+            return name_at(c.name_offset, c.name_length) < n;
+        });
+        if (first == entries.end() || name.empty()) return nullptr;
+        if (name_at(first->name_offset, first->name_length) == name) return &*first;
+        if (!header().prefix_matching) return nullptr;
+        // same rule as SubcommandIndex: all names sharing the prefix must belong to one command
+        const Child* match = nullptr;
+        for (auto it = first; it != entries.end() && name_at(it->name_offset, it->name_length).starts_with(name); ++it) {
+            if (match && match->node != it->node) return nullptr;
+            match = &*it;
+        }
+        return match;
+    }
+    inline const CompletionIndex::FlagEntry* CompletionIndex::find_flag(std::uint32_t node, std::string_view name, char shorthand) const {
+        auto entries = flags_of(node);
+        if (shorthand) {
+            auto it = std::find_if(entries.begin(), entries.end(), [shorthand] (const FlagEntry& f) {
+                return f.shorthand == static_cast<unsigned char>(shorthand);
+            });
+            return it != entries.end() ? &*it : nullptr;
+        }
+        auto it = std::lower_bound(entries.begin(), entries.end(), name, [this] (const FlagEntry& f, std::string_view n) {
+            return name_at(f.name_offset, f.name_length) < n;
+        });
+        return it != entries.end() && name_at(it->name_offset, it->name_length) == name ? &*it : nullptr;
+    }
+    inline std::string CompletionIndex::complete(std::span<const char* const> words) const {
+        std::string out;
+        if (empty()) return out;
+        std::string_view last = words.empty() ? std::string_view() : words.back();
+        std::uint32_t node = 0;
+        bool in_commands = true, in_flags = true;
+        // replays the parse of the words before the last, see detail::try_parse_argv
+        for (size_t i = 0; i + 1 < words.size(); i++) {
+            std::string_view word = words[i];
+            if (in_flags && word == "--") {
+                in_flags = in_commands = false;
+            } else if (in_flags && word.size() > 1 && word[0] == '-') {
+                const FlagEntry* flag = word[1] == '-'
+                    ? find_flag(node, word.substr(2), 0)
+                    : word.size() == 2 ? find_flag(node, {}, word[1]) : nullptr;
+                if (flag && flag->takes_value) {
+                    // the last word is this flag's value
+                    if (i + 2 == words.size()) return out;
+                    i++;
+                }
+            } else if (in_commands) {
+                const Child* child = find_child(node, word);
+                if (child) node = child->node;
+                else in_commands = false;
+            }
+        }
+        if (in_flags && last.starts_with("-")) {
+            std::string_view prefix = last.starts_with("--") ? last.substr(2) : last.substr(1);
+            if (last.size() == 1)
+                for (const FlagEntry& flag : flags_of(node))
+                    if (flag.shorthand) {
+                        out += '-';
+                        out += static_cast<char>(flag.shorthand);
+                        out += '\n';
+                    }
+            if (last.size() > 1 && last[1] != '-') {
+                // a complete shorthand, or one with its value attached
+                if (last.size() == 2 && find_flag(node, {}, last[1])) {
+                    out += last;
+                    out += '\n';
+                }
+                return out;
+            }
+            for (const FlagEntry& flag : flags_of(node)) {
+                std::string_view name = name_at(flag.name_offset, flag.name_length);
+                if (name.starts_with(prefix)) {
+                    out += "--";
+                    out += name;
+                    out += '\n';
+                }
+            }
+        } else if (in_commands) {
+            for (const Child& child : children_of(node)) {
+                std::string_view name = name_at(child.name_offset, child.name_length);
+                // aliases only once typed
+                if (name.starts_with(last) && (!child.is_alias || !last.empty())) {
+                    out += name;
+                    out += '\n';
+                }
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief Answers a completion request (`argv[1]` being `__complete`) from an index saved by
+     * a previous request, without building the tree.
+     *
+     * @param version identifies the tree, an index saved for another version is ignored
+     * @return the exit status if answered, nullopt if this isn't a completion request or there's no usable index
+     */
+    inline std::optional<int> completeFromCache(const std::string& path, std::string_view version, int argc, char** argv) {
+        if (argc < 2 || std::string_view(argv[1]) != "__complete")
+            return std::nullopt;
+        CompletionIndex index;
+        if (!index.open(path, CompletionIndex::stampOf(version)))
+            return std::nullopt;
+        utils::write_all(STDOUT_FILENO, index.complete(std::span<const char* const>(argv + 2, argc - 2)));
+        return 0;
+    }
+} // namespace pnt_cli
+
+#endif // COMPLETION_HPP_
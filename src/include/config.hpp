@@ -0,0 +1,274 @@
+/**
+ * @file config.hpp
+ * @author Zografos Orfeas
+ * @brief Immutable snapshots of flag values, published RCU style for lock-free concurrent reads.
+ * @version 0.1
+ * @date 2022-04-16
+ */
+
+#ifndef CONFIG_HPP_
+#define CONFIG_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#include <flag.hpp>
+#include <command.hpp>
+
+//!Note: Long running processes that treat flags as their configuration read them through a Config:
+//!Note:     Config config(root, [argv = saved_argv] (Command& root) mutable {
+//!Note:         auto args = argv;   // parsing permutes argv, so parse a copy
+//!Note:         root.parse(args.size(), args.data());
+//!Note:     });
+//!Note:     // worker threads
+//!Note:     auto snap = config.read();
+//!Note:     snap->getFlag<int>(*cmd, "workers");
+//!Note:     // SIGHUP handler calls config.requestReload(), a maintenance thread config.reloadIfRequested()
+
+namespace pnt_cli {
+    /**
+     * @brief Immutable copy of the values of every flag in a command tree, a FlagSet::Values per FlagSet.
+     * Flags are looked up through the (finalized, structurally unchanged) tree they were captured from.
+     */
+    class ConfigSnapshot {
+        private:
+            struct Entry {
+                const FlagSet* source;
+                FlagSet::Values values;
+            };
+            // sorted by source
+            std::vector<Entry> sets_;
+
+            void capture_command(const Command&, bool expand);
+            const FlagSet::Values* find(const FlagSet*) const;
+        public:
+            /**
+             * @param root root of the tree to capture
+             * @param expand whether to expand lazy subcommands to capture their flags too.
+             * Flags of subcommands left unexpanded are not captured (they have no values set yet).
+             */
+            explicit ConfigSnapshot(const Command& root, bool expand = true);
+
+            /**
+             * @brief Gets the captured value of a flag visible to `cmd`.
+             *
+             * @return std::optional<T> the value if found and of type `T`, nullopt otherwise
+             */
+            template<FlagType T>
+            std::optional<T> getFlag(const Command& cmd, std::string_view name) const;
+            /**
+             * @brief Like Command::resetParsed, restoring the captured values rather than the defaults,
+             * of the flags the last parse of `cmd`'s tree could have set. Flags not captured are reset.
+             */
+            void restoreParsed(Command& cmd) const;
+
+            ConfigSnapshot(ConfigSnapshot const&) = delete;
+            ConfigSnapshot& operator=(ConfigSnapshot const&) = delete;
+    };
+    inline ConfigSnapshot::ConfigSnapshot(const Command& root, bool expand) {
+        capture_command(root, expand);
+        std::sort(sets_.begin(), sets_.end(), [](const Entry& a, const Entry& b) {
+            return std::less<const FlagSet*>()(a.source, b.source);
+        });
+    }
+    inline void ConfigSnapshot::capture_command(const Command& cmd, bool expand) {
+        if (expand) cmd.expand();
+        for (const FlagSet* set : {&cmd.persistent_flags_, &cmd.local_flags_})
+            if (!set->empty())
+                sets_.push_back(Entry{set, set->capture()});
+        for (const Command* sub : cmd.subcommands_)
+            capture_command(*sub, expand);
+    }
+    inline const FlagSet::Values* ConfigSnapshot::find(const FlagSet* source) const {
+        auto it = std::lower_bound(sets_.begin(), sets_.end(), source, [](const Entry& e, const FlagSet* s) {
+            return std::less<const FlagSet*>()(e.source, s);
+        });
+        return it != sets_.end() && it->source == source ? &it->values : nullptr;
+    }
+    inline void ConfigSnapshot::restoreParsed(Command& cmd) const {
+        Command* root = &cmd;
+        while (root->parent_) root = root->parent_;
+        for (Command* parsed = root->parsed_; parsed; parsed = parsed->parent_) {
+            for (FlagSet* set : {&parsed->persistent_flags_, &parsed->local_flags_}) {
+                if (const FlagSet::Values* values = find(set)) set->restore(*values);
+                else set->reset();
+            }
+        }
+        root->parsed_ = nullptr;
+    }
+    template<FlagType T>
+    inline std::optional<T> ConfigSnapshot::getFlag(const Command& cmd, std::string_view name) const {
+        FlagRef flag = cmd.find_flag_simple(name);
+        const FlagSet::Values* values = flag ? find(flag.set()) : nullptr;
+        return values ? values->get<T>(flag) : std::nullopt;
+    }
+
+    namespace detail {
+        /**
+         * @brief Two-epoch grace period tracking for RCU style reclamation.
+         * Readers count themselves in, in the counter of the current epoch's parity, sharded per
+         * thread over cache lines so concurrent readers don't contend. A writer flips the epoch and
+         * waits for the previous parity's counters to drain before reclaiming what it unpublished.
+         */
+        class EpochDomain {
+            private:
+                static constexpr size_t shards = 32;
+                struct alignas(64) Counter {
+                    std::atomic<std::int64_t> readers{0};
+                };
+                std::atomic<std::uint64_t> epoch_{0};
+                std::array<std::array<Counter, shards>, 2> counters_;
+
+                static size_t thread_shard() {
+                    static std::atomic<size_t> next{0};
+                    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % shards;
+                    return shard;
+                }
+            public:
+                /**
+                 * @brief Enters a read side critical section.
+                 *
+                 * @return the counter to pass to leave()
+                 */
+                std::atomic<std::int64_t>* enter() {
+                    size_t shard = thread_shard();
+                    while (true) {
+                        std::uint64_t epoch = epoch_.load();
+                        auto* counter = &counters_[epoch & 1][shard].readers;
+                        counter->fetch_add(1);
+                        // a writer may have flipped the epoch and checked this counter in between
+                        if (epoch_.load() == epoch)
+                            return counter;
+                        counter->fetch_sub(1);
+                    }
+                }
+                void leave(std::atomic<std::int64_t>* counter) {
+                    counter->fetch_sub(1, std::memory_order_release);
+                }
+                /**
+                 * @brief Waits for all readers that may have seen data unpublished before the call.
+                 *!Note writers must be serialized
+                 */
+                void synchronize() {
+                    std::uint64_t previous = epoch_.fetch_add(1);
+                    for (auto& counter : counters_[previous & 1])
+                        while (counter.readers.load(std::memory_order_acquire) != 0)
+                            std::this_thread::yield();
+                }
+        };
+    } // namespace detail
+
+    /**
+     * @brief Publishes ConfigSnapshots of a command tree for lock-free concurrent reads, re-running
+     * a loader and publishing a new snapshot on reload. Old snapshots are reclaimed once no reader
+     * can still be using them.
+     */
+    class Config {
+        public:
+            /**
+             * @brief Re-applies the configuration sources (argv, files, environment...) to the tree.
+             * Called on the writer side only, with all flags reset to their defaults.
+             */
+            using Loader = std::function<void(Command&)>;
+
+            /**
+             * @brief Pins the snapshot current at the time of reading. Readers should hold it briefly,
+             * as reloads wait for it to be released.
+             */
+            class ReadGuard {
+                private:
+                    detail::EpochDomain* domain_;
+                    std::atomic<std::int64_t>* counter_;
+                    const ConfigSnapshot* snapshot_;
+                public:
+                    ReadGuard(detail::EpochDomain* domain, const std::atomic<ConfigSnapshot*>& current)
+                        : domain_(domain), counter_(domain->enter()), snapshot_(current.load()) {}
+                    ReadGuard(ReadGuard&& other) noexcept
+                        : domain_(other.domain_), counter_(std::exchange(other.counter_, nullptr)), snapshot_(other.snapshot_) {}
+                    ~ReadGuard() { if (counter_) domain_->leave(counter_); }
+                    const ConfigSnapshot& operator*() const { return *snapshot_; }
+                    const ConfigSnapshot* operator->() const { return snapshot_; }
+
+                    ReadGuard(ReadGuard const&) = delete;
+                    ReadGuard& operator=(ReadGuard const&) = delete;
+                    ReadGuard& operator=(ReadGuard&&) = delete;
+            };
+        private:
+            std::shared_ptr<Command> root_;
+            Loader loader_;
+            std::atomic<ConfigSnapshot*> current_{nullptr};
+            detail::EpochDomain domain_;
+            std::mutex writer_mutex_;
+            std::atomic<bool> reload_requested_{false};
+        public:
+            /**
+             * @brief Finalizes the tree, runs the loader and publishes the first snapshot.
+             * The tree must not change structurally (flags, subcommands) afterwards.
+             */
+            Config(std::shared_ptr<Command> root, Loader loader);
+            ~Config();
+
+            /**
+             * @brief Lock-free access to the current snapshot.
+             */
+            ReadGuard read();
+            /**
+             * @brief Resets the tree to its defaults, re-runs the loader and publishes a new snapshot.
+             * Returns once the previous snapshot has been reclaimed.
+             */
+            void reload();
+            /**
+             * @brief Async-signal-safe request for a reload, e.g. from a SIGHUP handler.
+             */
+            void requestReload() noexcept;
+            /**
+             * @brief Reloads if requested since the last call.
+             *
+             * @return true if reloaded
+             */
+            bool reloadIfRequested();
+
+            Config(Config const&) = delete;
+            Config& operator=(Config const&) = delete;
+    };
+    inline Config::Config(std::shared_ptr<Command> root, Loader loader)
+        : root_(std::move(root)), loader_(std::move(loader)) {
+        root_->finalize();
+        reload();
+    }
+    inline Config::~Config() {
+        delete current_.load();
+    }
+    inline Config::ReadGuard Config::read() {
+        return ReadGuard(&domain_, current_);
+    }
+    inline void Config::reload() {
+        std::lock_guard lock(writer_mutex_);
+        root_->reset();
+        if (loader_) loader_(*root_);
+        ConfigSnapshot* previous = current_.exchange(new ConfigSnapshot(*root_));
+        domain_.synchronize();
+        delete previous;
+    }
+    inline void Config::requestReload() noexcept {
+        reload_requested_.store(true, std::memory_order_relaxed);
+    }
+    inline bool Config::reloadIfRequested() {
+        if (!reload_requested_.exchange(false))
+            return false;
+        reload();
+        return true;
+    }
+} // namespace pnt_cli
+
+#endif // CONFIG_HPP_
@@ -10,64 +10,503 @@
 #define FLAG_HPP_
 
 #include <string>
-#include <map>
+#include <string_view>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
+#include <span>
 #include <optional>
 #include <concepts>
+#include <charconv>
+#include <stdexcept>
+#include <system_error>
+#include <bit>
+#include <type_traits>
+#include <utility>
+#include <tuple>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <log.hpp>
 #include <utils.hpp>
 
 namespace pnt_cli {
     //!Note: To extend, implement pnt_cli::fromString<T>, pnt_cli::toString<T> by explicitly specializing for your type T.
+    //!Note: Optionally also specialize pnt_cli::tryFromString<T> to report malformed input without exceptions.
+
+    /**
+     * @brief Why a string could not be converted to a flag value.
+     */
+    enum class ConversionError {
+        none,
+        invalid_argument,   // not a (complete) representation of the type
+        out_of_range        // representable, but not in the type's range
+    };
+    inline const char* conversionErrorMessage(ConversionError err) {
+        switch (err) {
+            case ConversionError::none: return "no error";
+            case ConversionError::invalid_argument: return "invalid argument";
+            case ConversionError::out_of_range: return "out of range";
+        }
+        return "unknown error";
+    }
     
     template<typename T> inline T fromString(const std::string& str);
     template<typename T> inline std::string toString(const T& val);
+    /**
+     * @brief Converts `str` into `out`, leaving `out` untouched on failure.
+     * By default forwards to fromString<T>, so errors are reported however fromString<T> does.
+     */
+    template<typename T> inline ConversionError tryFromString(std::string_view str, T& out) {
+        out = fromString<T>(std::string(str));
+        return ConversionError::none;
+    }
 
     template<typename T>
-    concept FlagType = requires (T t, const std::string& s) {
+    concept FlagType = requires (T t, const std::string& s, std::string_view sv) {
         { pnt_cli::fromString<T>(s) } -> std::same_as<T>;
         { pnt_cli::toString<T>(t) } -> std::same_as<std::string>;
+        { pnt_cli::tryFromString<T>(sv, t) } -> std::same_as<ConversionError>;
     };
 
-    // TODO: test and document erroneous input to fromString
+    namespace detail {
+        /**
+         * @brief Maps the result of std::from_chars over the whole of `str` to a ConversionError.
+         */
+        inline ConversionError from_chars_error(std::string_view str, std::from_chars_result res) {
+            if (res.ec == std::errc::result_out_of_range) return ConversionError::out_of_range;
+            if (res.ec != std::errc() || res.ptr != str.data() + str.size()) return ConversionError::invalid_argument;
+            return ConversionError::none;
+        }
+        /**
+         * @brief Throws the std::stoi style exception matching a failed conversion.
+         */
+        [[noreturn]] inline void throw_conversion_error(ConversionError err, std::string_view str) {
+            std::string what = std::string("fromString: ") + conversionErrorMessage(err) + ": " + std::string(str);
+            if (err == ConversionError::out_of_range) utils::raise<std::out_of_range>(what);
+            utils::raise<std::invalid_argument>(what);
+        }
+    } // namespace detail
+
+    //!Note: Numbers are parsed with std::from_chars: locale independent, in the exact type and range checked.
+    //!Note: The whole string must be consumed, leading whitespace and '+' are rejected.
+    //!Note: bool accepts "true"/"1" and "false"/"0".
+    template<std::integral T> inline ConversionError tryFromString(std::string_view str, T& out) {
+        if constexpr (std::same_as<T, bool>) {
+            if (str == "true" || str == "1") { out = true; return ConversionError::none; }
+            if (str == "false" || str == "0") { out = false; return ConversionError::none; }
+            return ConversionError::invalid_argument;
+        } else {
+            T val{};
+            auto err = detail::from_chars_error(str, std::from_chars(str.data(), str.data() + str.size(), val));
+            if (err == ConversionError::none) out = val;
+            return err;
+        }
+    }
+    template<std::floating_point T> inline ConversionError tryFromString(std::string_view str, T& out) {
+        T val{};
+        auto err = detail::from_chars_error(str, std::from_chars(str.data(), str.data() + str.size(), val));
+        if (err == ConversionError::none) out = val;
+        return err;
+    }
+    template<> inline ConversionError tryFromString<std::string>(std::string_view str, std::string& out) {
+        out = str;
+        return ConversionError::none;
+    }
+    //!Note: std::string_view flags view the token they were set from (argv, a mapped response or config file,
+    //!Note: the environment) without copying it, see detail::FlagColumn for how long it lives.
+    template<> inline ConversionError tryFromString<std::string_view>(std::string_view str, std::string_view& out) {
+        out = str;
+        return ConversionError::none;
+    }
+
+    namespace detail {
+        template<typename T>
+        inline T from_string_or_throw(std::string_view str) {
+            T val{};
+            if (auto err = tryFromString<T>(str, val); err != ConversionError::none)
+                throw_conversion_error(err, str);
+            return val;
+        }
+    } // namespace detail
     
-    template<std::integral T> inline T fromString(const std::string& str) { return std::stoi(str); }
+    template<std::integral T> inline T fromString(const std::string& str) { return detail::from_string_or_throw<T>(str); }
     template<std::integral T> inline std::string toString(const T& val) {return std::to_string(val); }
 
-    template<std::floating_point T> inline T fromString(const std::string& str) { return std::stof(str); }
-    template<std::floating_point T> inline std::string toString(const T& val) {return std::to_string(val); }
+    template<std::floating_point T> inline T fromString(const std::string& str) { return detail::from_string_or_throw<T>(str); }
+    // shortest representation that round-trips through fromString
+    template<std::floating_point T> inline std::string toString(const T& val) {
+        char buf[64];
+        auto res = std::to_chars(buf, buf + sizeof(buf), val);
+        return std::string(buf, res.ptr);
+    }
 
     template<> inline std::string fromString<std::string>(const std::string& str) { return str; }
     template<> inline std::string toString<std::string>(const std::string& val) { return val; }
 
-    template<> inline bool fromString<bool>(const std::string& str) { return "true" == str ? true : false; }
+    // views `str`, which must outlive the result
+    template<> inline std::string_view fromString<std::string_view>(const std::string& str) { return str; }
+    template<> inline std::string toString<std::string_view>(const std::string_view& val) { return std::string(val); }
+
+    // accepts what tryFromString<bool> does, so a bool flag converts alike whether set or parsed
+    template<> inline bool fromString<bool>(const std::string& str) { return detail::from_string_or_throw<bool>(str); }
     template<> inline std::string toString<bool>(const bool& val) { return val ? "true" : "false"; }
 
+    //!Note: std::vector<T> of any FlagType T is a list flag type. Lists are written comma separated (no escaping)
+    //!Note: and every occurrence of a list flag appends to the values given since its last reset, replacing the default.
+    namespace detail {
+        template<typename T> struct is_list : std::false_type {};
+        template<typename T, typename A> struct is_list<std::vector<T, A>> : std::true_type {};
+    } // namespace detail
+    template<typename T>
+    concept ListType = detail::is_list<T>::value && FlagType<typename T::value_type>;
+
+    namespace detail {
+        /**
+         * @brief Calls `f(base, mask)` for `str` in 16 byte blocks, bit i of `mask` being set
+         * if `str[base + i]` is `delim`. Blocks without delimiters may be skipped.
+         * Compares a whole block at a time with SSE2 where available.
+         */
+        template<typename F>
+        inline void for_each_delimiter_mask(std::string_view str, char delim, F&& f) {
+            size_t base = 0;
+#ifdef __SSE2__
+            const __m128i needle = _mm_set1_epi8(delim);
+            for (; base + 16 <= str.size(); base += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + base));
+                if (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle))))
+                    f(base, mask);
+            }
+#endif
+            for (; base < str.size(); base += 16) {
+                std::uint32_t mask = 0;
+                for (size_t i = 0; i < 16 && base + i < str.size(); i++)
+                    mask |= static_cast<std::uint32_t>(str[base + i] == delim) << i;
+                if (mask) f(base, mask);
+            }
+        }
+        inline size_t count_delimiters(std::string_view str, char delim) {
+            size_t count = 0;
+            for_each_delimiter_mask(str, delim, [&count] (size_t, std::uint32_t mask) { count += std::popcount(mask); });
+            return count;
+        }
+        /**
+         * @brief Appends the `delim` separated elements of `str` to `out`, each converted with tryFromString.
+         * Storage for all of them is reserved before converting any, on failure `out` is left as it was.
+         * An empty `str` holds no elements.
+         */
+        template<FlagType T, typename A>
+        inline ConversionError append_list(std::string_view str, std::vector<T, A>& out, char delim = ',') {
+            if (str.empty()) return ConversionError::none;
+            const size_t old_size = out.size();
+            const size_t new_size = old_size + count_delimiters(str, delim) + 1;
+            // keep growth geometric across repeated occurrences
+            if (new_size > out.capacity())
+                out.reserve(std::max(new_size, 2 * out.capacity()));
+            ConversionError err = ConversionError::none;
+            size_t start = 0;
+            auto convert = [&] (size_t end) {
+                if (err != ConversionError::none) return;
+                T val{};
+                err = tryFromString<T>(str.substr(start, end - start), val);
+                if (err == ConversionError::none) out.push_back(std::move(val));
+                start = end + 1;
+            };
+            for_each_delimiter_mask(str, delim, [&convert] (size_t base, std::uint32_t mask) {
+                for (; mask; mask &= mask - 1)
+                    convert(base + std::countr_zero(mask));
+            });
+            convert(str.size());
+            if (err != ConversionError::none)
+                out.erase(out.begin() + old_size, out.end());
+            return err;
+        }
+    } // namespace detail
+
+    template<ListType T> inline ConversionError tryFromString(std::string_view str, T& out) {
+        T val;
+        auto err = detail::append_list(str, val);
+        if (err == ConversionError::none) out = std::move(val);
+        return err;
+    }
+    // detail::from_string_or_throw is declared too early to see the list overloads
+    template<ListType T> inline T fromString(const std::string& str) {
+        T val;
+        if (auto err = detail::append_list(str, val); err != ConversionError::none)
+            detail::throw_conversion_error(err, str);
+        return val;
+    }
+    template<ListType T> inline std::string toString(const T& val) {
+        std::string str;
+        for (bool first = true; const auto& elem : val) {
+            if (!first) str += ',';
+            str += toString<typename T::value_type>(elem);
+            first = false;
+        }
+        return str;
+    }
+
+    namespace detail {
+        template<typename T>
+        inline std::string type_name() {
+            if constexpr (std::same_as<T, bool>) return "bool";
+            else if constexpr (std::integral<T>) return std::is_signed_v<T> ? "int" : "uint";
+            else if constexpr (std::floating_point<T>) return "float";
+            else if constexpr (std::same_as<T, std::string> || std::same_as<T, std::string_view>) return "string";
+            else if constexpr (is_list<T>::value) return type_name<typename T::value_type>() + "s";
+            else return "value";
+        }
+
+        template<typename... Ts> struct type_list {};
+        /**
+         * @brief Flag types a FlagSet stores by value, in one contiguous array per type.
+         * A type's position in the list is its flag kind, the tag flags are dispatched on.
+         */
+        using builtin_flag_types = type_list<bool, char, signed char, unsigned char, short, unsigned short,
+            int, unsigned int, long, unsigned long, long long, unsigned long long,
+            float, double, long double, std::string, std::string_view>;
+
+        template<typename T, typename... Ts>
+        constexpr std::uint8_t kind_of(type_list<Ts...>) {
+            constexpr bool matches[] = {std::same_as<T, Ts>...};
+            std::uint8_t kind = 0;
+            while (kind < sizeof...(Ts) && !matches[kind]) kind++;
+            return kind;
+        }
+        // the kind of every other flag type, kept behind a Flag node
+        inline constexpr std::uint8_t custom_flag_kind = kind_of<void>(builtin_flag_types{});
+        template<typename T>
+        inline constexpr std::uint8_t flag_kind = kind_of<T>(builtin_flag_types{});
+
+        /**
+         * @brief Flag types stored by value and converted as they are set:
+         * bool, the standard arithmetic types (char and short included) and strings.
+         */
+        template<typename T>
+        concept BuiltinFlagType = flag_kind<T> != custom_flag_kind;
+
+        /**
+         * @brief What getters return: small trivially copyable values by value, other values by const reference.
+         */
+        template<typename T>
+        using get_result_t = std::conditional_t<std::is_trivially_copyable_v<T> && sizeof(T) <= 2 * sizeof(void*), T, const T&>;
+
+        /**
+         * @brief Raw token of a flag whose conversion is deferred to its first read.
+         */
+        struct PendingToken {
+            // the token as set by parsing, or owned
+            std::string_view token;
+            // backs token when it may not outlive the flag
+            std::string owned;
+            bool pending = false;
+
+            PendingToken() = default;
+            // copies (e.g. ConfigSnapshot's) outlive the buffers tokens come from
+            PendingToken(const PendingToken& other) { *this = other; }
+            PendingToken& operator=(const PendingToken& other) {
+                if (this != &other) {
+                    if (other.pending) own(other.token);
+                    pending = other.pending;
+                }
+                return *this;
+            }
+            void view(std::string_view str) {
+                token = str;
+                pending = true;
+            }
+            void own(std::string_view str) {
+                owned.assign(str);
+                token = owned;
+                pending = true;
+            }
+        };
+
+        // captured std::string_view values own their text
+        template<typename T>
+        using captured_t = std::conditional_t<std::same_as<T, std::string_view>, std::string, T>;
+
+        struct NoBacking {
+            explicit NoBacking(std::pmr::memory_resource*) {}
+        };
+        // std::vector<bool> packs bits, bool values are kept a byte each to be referenced like the others
+        struct BoolValue {
+            bool value;
+            BoolValue(bool val) : value(val) {}
+            operator bool() const { return value; }
+        };
+        template<typename T>
+        using stored_t = std::conditional_t<std::same_as<T, bool>, BoolValue, T>;
+        /**
+         * @brief The values and defaults of the flags of one built-in type of a FlagSet, by slot.
+         * std::string_view values view the token they were last set from, without copying it. Tokens set
+         * by parsing live as long as argv and, for response files, until the command tree is parsed again.
+         * Tokens set by a ConfigFile live as long as it, by an EnvSource as long as the environment is
+         * unchanged. Values set from a std::string (FlagRef::set) are copied into `owned`.
+         * Defaults of std::string_view flags must outlive the FlagSet, e.g. string literals.
+         */
+        template<typename T>
+        struct FlagColumn {
+            static constexpr bool owns_views = std::same_as<T, std::string_view>;
+
+            std::pmr::vector<stored_t<T>> values;
+            std::pmr::vector<stored_t<T>> defaults;
+            [[no_unique_address]] std::conditional_t<owns_views, std::pmr::vector<std::string>, NoBacking> owned;
+
+            explicit FlagColumn(std::pmr::memory_resource* resource)
+                : values(resource), defaults(resource), owned(resource) {}
+            T& value(std::uint32_t slot) {
+                if constexpr (std::same_as<T, bool>) return values[slot].value;
+                else return values[slot];
+            }
+            /**
+             * @return the slot of the new flag
+             */
+            std::uint32_t add(T default_value);
+            void set(std::uint32_t slot, const std::string& str);
+            void reset(std::uint32_t slot) { values[slot] = defaults[slot]; }
+            void reset() { values.assign(defaults.begin(), defaults.end()); }
+            std::vector<captured_t<T>> capture() const { return {values.begin(), values.end()}; }
+            /**
+             * @brief Sets the values to `captured`, resetting the flags added since it was captured.
+             */
+            void restore(const std::vector<captured_t<T>>& captured);
+        };
+        template<typename T>
+        inline std::uint32_t FlagColumn<T>::add(T default_value) {
+            if constexpr (owns_views) {
+                // growing moves the owned strings, short ones to a new address: keep the values viewing them
+                if (owned.size() == owned.capacity()) {
+                    std::pmr::vector<std::string> grown(owned.get_allocator());
+                    grown.reserve(std::max<size_t>(4, 2 * owned.size()));
+                    for (size_t i = 0; i < owned.size(); i++) {
+                        const bool viewed = values[i].data() == owned[i].data();
+                        grown.push_back(std::move(owned[i]));
+                        if (viewed) values[i] = grown.back();
+                    }
+                    owned.swap(grown);
+                }
+                owned.emplace_back();
+            }
+            values.push_back(default_value);
+            defaults.push_back(std::move(default_value));
+            return static_cast<std::uint32_t>(values.size() - 1);
+        }
+        template<typename T>
+        inline void FlagColumn<T>::set(std::uint32_t slot, const std::string& str) {
+            if constexpr (owns_views) {
+                owned[slot] = str;
+                values[slot] = owned[slot];
+            } else {
+                values[slot] = fromString<T>(str);
+            }
+        }
+        template<typename T>
+        inline void FlagColumn<T>::restore(const std::vector<captured_t<T>>& captured) {
+            const size_t restored = std::min(captured.size(), values.size());
+            for (size_t i = 0; i < restored; i++) {
+                if constexpr (owns_views) {
+                    owned[i] = captured[i];
+                    values[i] = owned[i];
+                } else {
+                    values[i] = captured[i];
+                }
+            }
+            for (size_t i = restored; i < values.size(); i++)
+                values[i] = defaults[i];
+        }
+
+        template<typename> struct FlagColumnsOf;
+        template<typename... Ts> struct FlagColumnsOf<type_list<Ts...>> {
+            std::tuple<FlagColumn<Ts>...> columns;
+            explicit FlagColumnsOf(std::pmr::memory_resource* resource) : columns(FlagColumn<Ts>(resource)...) {}
+        };
+        // one FlagColumn per built-in flag type, in flag kind order
+        using FlagColumns = FlagColumnsOf<builtin_flag_types>;
+
+        template<typename> struct captured_columns;
+        template<typename... Ts> struct captured_columns<type_list<Ts...>> {
+            using type = std::tuple<std::vector<captured_t<Ts>>...>;
+        };
+        using CapturedColumns = captured_columns<builtin_flag_types>::type;
+
+        /**
+         * @brief Destroys objects, only freeing the ones not allocated from a caller supplied resource.
+         */
+        struct ArenaDeleter {
+            bool owns_memory = true;
+            template<typename T>
+            void operator()(T* ptr) const {
+                if (owns_memory) delete ptr;
+                else std::destroy_at(ptr);
+            }
+        };
+    } // namespace detail
+
     template<FlagType T>
     class FlagImpl;
 
+    /**
+     * @brief Value of a flag of a custom type (neither arithmetic nor a string), which a FlagSet
+     * keeps behind a pointer and sets and reads through virtual calls. Flags of built-in types are
+     * stored by value in their FlagSet instead, see FlagRef.
+     */
     class Flag {
-        private:
-            std::string name_;
-            std::string shorthand_;
-            std::string description_;
         protected:
             utils::type_id_t type_id_;
-            Flag(std::string name, std::string shorthand, std::string description, utils::type_id_t type_id_val)
-                : name_(name), shorthand_(shorthand), description_(description), type_id_(type_id_val) {}
+            explicit Flag(utils::type_id_t type_id_val) : type_id_(type_id_val) {}
         public:
             virtual void set(const std::string&) = 0;
+            /**
+             * @brief Sets the flag from a string without throwing on malformed input
+             * (unless the flag type's conversion does), leaving the value untouched on failure.
+             */
+            virtual ConversionError trySet(std::string_view) = 0;
+            /**
+             * @brief trySet for tokens that may not outlive the flag (config files, the environment).
+             * Flags that keep the token to convert it on first read copy it.
+             */
+            virtual ConversionError trySetCopy(std::string_view str) { return trySet(str); }
+            /**
+             * @brief Restores the default value of the flag.
+             */
+            virtual void reset() = 0;
+            /**
+             * @brief Copies the flag, value included.
+             */
+            virtual std::unique_ptr<Flag> clone() const = 0;
+            /**
+             * @brief Sets the value of the flag to that of `other`, a flag of the same type (e.g. a clone).
+             */
+            virtual void assign(const Flag& other) = 0;
+            /**
+             * @brief The default value, as toString formats it.
+             */
+            virtual std::string defaultString() const = 0;
+            /**
+             * @brief Short name of the value type shown in help, e.g. "int".
+             */
+            virtual std::string typeName() const = 0;
+            /**
+             * @brief Converts a value whose conversion was deferred to its first read, see FlagImpl.
+             */
+            virtual ConversionError validate() const { return ConversionError::none; }
+            /**
+             * @brief The token of a value not converted yet, empty if there is none.
+             */
+            virtual std::string_view pendingValue() const { return {}; }
             /**
              * @brief Check if the flag type matches the function template argument type.
-             * 
+             *
              * @tparam T Type to check against
              * @return true if matches
              */
             template<FlagType T> bool typeMatches() const ;
             template<FlagType T> FlagImpl<T>* as();
-            // overload stream operator for printing
-            friend std::ostream& operator<<(std::ostream&, const Flag&); 
             Flag() = delete;
             virtual ~Flag() = default;
     };
@@ -79,64 +518,438 @@ namespace pnt_cli {
             static_cast<FlagImpl<T>*>(this) :
             nullptr;
     }
-    inline std::ostream& operator<<(std::ostream& os, const Flag& f) {
-        os << "{" <<  f.name_ << " (" << f.shorthand_ << ") " << f.description_ << "}";
-        return os;
-    }
 
+    /**
+     * @brief Flag of a single value of a custom type.
+     * Keeps the token it is set from (trySet, trySetCopy) and converts it on first read, so expensive
+     * conversions are only paid for by the flags an action reads. A malformed token is reported by that
+     * read, raising like set would, or by validate(). set converts immediately.
+     * Tokens set by parsing (trySet) are viewed like std::string_view flag values: they live as long as
+     * argv and, for response files, until the command tree is parsed again. Tokens set from config files
+     * and the environment (trySetCopy) are copied.
+     *!Note reading a flag with a deferred conversion writes to it, validate before reading from multiple threads
+     */
     template<FlagType T>
-    class FlagImpl : public Flag {
+    class FlagImpl final : public Flag {
+        static_assert(!detail::BuiltinFlagType<T>, "FlagSet stores flags of built-in types by value");
         private:
-            T value;
+            mutable T value;
+            T default_value;
+            mutable detail::PendingToken pending_;
+
+            void resolve() const;
         public:
             FlagImpl() = delete;
-            FlagImpl(std::string name, std::string shorthand, std::string description, T defaultVal) 
-                : Flag(name, shorthand, description, utils::type_id<T>()), value(defaultVal) {};
+            explicit FlagImpl(T defaultVal)
+                : Flag(utils::type_id<T>()), value(defaultVal), default_value(defaultVal) {};
             void set(const std::string&) override;
-            T get() const;
-            ~FlagImpl() = default;    
+            ConversionError trySet(std::string_view) override;
+            ConversionError trySetCopy(std::string_view) override;
+            void reset() override;
+            std::unique_ptr<Flag> clone() const override;
+            void assign(const Flag&) override;
+            std::string defaultString() const override;
+            std::string typeName() const override;
+            ConversionError validate() const override;
+            std::string_view pendingValue() const override;
+            detail::get_result_t<T> get() const;
+            /**
+             * @brief The current value, without copying it.
+             */
+            const T& view() const { resolve(); return value; }
+            ~FlagImpl() = default;
     };
     template<FlagType T>
     inline void FlagImpl<T>::set(const std::string& str)  {
         value = fromString<T>(str);
+        pending_.pending = false;
+    }
+    template<FlagType T>
+    inline ConversionError FlagImpl<T>::trySet(std::string_view str) {
+        // parsed tokens live in argv or the root's response files, no need to copy them
+        pending_.view(str);
+        return ConversionError::none;
+    }
+    template<FlagType T>
+    inline ConversionError FlagImpl<T>::trySetCopy(std::string_view str) {
+        pending_.own(str);
+        return ConversionError::none;
+    }
+    template<FlagType T>
+    inline ConversionError FlagImpl<T>::validate() const {
+        if (!pending_.pending) return ConversionError::none;
+        // a failed conversion leaves value and the token as they were, for every read to report
+        ConversionError err = tryFromString<T>(pending_.token, value);
+        if (err == ConversionError::none) pending_.pending = false;
+        return err;
+    }
+    template<FlagType T>
+    inline std::string_view FlagImpl<T>::pendingValue() const {
+        return pending_.pending ? pending_.token : std::string_view();
+    }
+    template<FlagType T>
+    inline void FlagImpl<T>::resolve() const {
+        if (pending_.pending)
+            if (auto err = validate(); err != ConversionError::none)
+                detail::throw_conversion_error(err, pending_.token);
+    }
+    template<FlagType T>
+    inline void FlagImpl<T>::reset() {
+        value = default_value;
+        pending_.pending = false;
+    }
+    template<FlagType T>
+    inline std::unique_ptr<Flag> FlagImpl<T>::clone() const {
+        auto copy = std::make_unique<FlagImpl<T>>(*this);
+        // converted up front, copies such as ConfigSnapshot's are read from multiple threads
+        (void)copy->validate();
+        return copy;
     }
-    template<FlagType T> inline T FlagImpl<T>::get() const {
+    template<FlagType T>
+    inline void FlagImpl<T>::assign(const Flag& other) {
+        auto& from = static_cast<const FlagImpl<T>&>(other);
+        value = from.value;
+        pending_ = from.pending_;
+    }
+    template<FlagType T>
+    inline std::string FlagImpl<T>::defaultString() const {
+        return toString<T>(default_value);
+    }
+    template<FlagType T>
+    inline std::string FlagImpl<T>::typeName() const {
+        return detail::type_name<T>();
+    }
+    template<FlagType T> inline detail::get_result_t<T> FlagImpl<T>::get() const {
+        resolve();
+        return value;
+    }
+
+    /**
+     * @brief List flag, collecting the elements of all its occurrences.
+     */
+    template<FlagType T>
+    class FlagImpl<std::vector<T>> final : public Flag {
+        private:
+            std::vector<T> value;
+            std::vector<T> default_value;
+            // whether value holds occurrences rather than the default
+            bool appending = false;
+        public:
+            FlagImpl() = delete;
+            explicit FlagImpl(std::vector<T> defaultVal)
+                : Flag(utils::type_id<std::vector<T>>()), value(defaultVal), default_value(defaultVal) {};
+            void set(const std::string&) override;
+            ConversionError trySet(std::string_view) override;
+            void reset() override;
+            std::unique_ptr<Flag> clone() const override;
+            void assign(const Flag&) override;
+            std::string defaultString() const override;
+            std::string typeName() const override;
+            const std::vector<T>& get() const;
+            const std::vector<T>& view() const { return value; }
+            ~FlagImpl() = default;
+    };
+    template<FlagType T>
+    inline void FlagImpl<std::vector<T>>::set(const std::string& str) {
+        if (auto err = trySet(str); err != ConversionError::none)
+            detail::throw_conversion_error(err, str);
+    }
+    template<FlagType T>
+    inline ConversionError FlagImpl<std::vector<T>>::trySet(std::string_view str) {
+        if (appending)
+            return detail::append_list(str, value);
+        std::vector<T> occurrence;
+        auto err = detail::append_list(str, occurrence);
+        if (err == ConversionError::none) {
+            value = std::move(occurrence);
+            appending = true;
+        }
+        return err;
+    }
+    template<FlagType T>
+    inline void FlagImpl<std::vector<T>>::reset() {
+        value = default_value;
+        appending = false;
+    }
+    template<FlagType T>
+    inline std::unique_ptr<Flag> FlagImpl<std::vector<T>>::clone() const {
+        return std::make_unique<FlagImpl<std::vector<T>>>(*this);
+    }
+    template<FlagType T>
+    inline void FlagImpl<std::vector<T>>::assign(const Flag& other) {
+        auto& from = static_cast<const FlagImpl<std::vector<T>>&>(other);
+        value = from.value;
+        // occurrences append to values set otherwise, as after a ConfigFile
+        appending = from.appending;
+    }
+    template<FlagType T>
+    inline std::string FlagImpl<std::vector<T>>::defaultString() const {
+        return toString<std::vector<T>>(default_value);
+    }
+    template<FlagType T>
+    inline std::string FlagImpl<std::vector<T>>::typeName() const {
+        return detail::type_name<std::vector<T>>();
+    }
+    template<FlagType T> inline const std::vector<T>& FlagImpl<std::vector<T>>::get() const {
         return value;
     }
 
+    class FlagSet;
+
+    /**
+     * @brief Reference to a flag of a FlagSet: the set, the flag's kind (its type's tag) and its slot
+     * in the set's storage for that kind. Flags of built-in types are set and read directly in the set's
+     * array of values of their type, flags of custom types through their Flag.
+     * Valid for as long as the FlagSet.
+     */
+    class FlagRef {
+        private:
+            FlagSet* set_ = nullptr;
+            // position in the FlagSet, in order of registration
+            std::uint32_t id_ = 0;
+            std::uint32_t slot_ = 0;
+            std::uint8_t kind_ = 0;
+        public:
+            FlagRef() = default;
+            FlagRef(FlagSet* set, std::uint32_t id, std::uint8_t kind, std::uint32_t slot)
+                : set_(set), id_(id), slot_(slot), kind_(kind) {}
+
+            explicit operator bool() const { return set_ != nullptr; }
+            bool operator==(const FlagRef&) const = default;
+            FlagSet* set() const { return set_; }
+            std::uint8_t kind() const { return kind_; }
+            std::uint32_t slot() const { return slot_; }
+
+            const std::string& name() const;
+            const std::string& shorthand() const;
+            const std::string& description() const;
+            /**
+             * @brief Check if the flag type matches the function template argument type.
+             */
+            template<FlagType T> bool typeMatches() const;
+            /**
+             * @brief The current value if the flag is of type `T`, nullptr otherwise.
+             * Values of built-in types move when a flag of the same type is added to the set.
+             */
+            template<FlagType T> const T* getIf() const;
+            /**
+             * @brief Sets the flag from a string, raising on malformed input.
+             */
+            void set(const std::string&) const;
+            /**
+             * @brief Sets the flag from a string without throwing on malformed input
+             * (unless the flag type's conversion does), leaving the value untouched on failure.
+             */
+            ConversionError trySet(std::string_view) const;
+            /**
+             * @brief trySet for tokens that may not outlive the flag (config files, the environment).
+             */
+            ConversionError trySetCopy(std::string_view) const;
+            /**
+             * @brief Restores the default value of the flag.
+             */
+            void reset() const;
+            /**
+             * @brief The default value, as toString formats it.
+             */
+            std::string defaultString() const;
+            /**
+             * @brief Short name of the value type shown in help, e.g. "int".
+             */
+            std::string typeName() const;
+            /**
+             * @brief Converts a value whose conversion was deferred to its first read, see FlagImpl.
+             */
+            ConversionError validate() const;
+            /**
+             * @brief The token of a value not converted yet, empty if there is none.
+             */
+            std::string_view pendingValue() const;
+    };
+
+    /**
+     * @brief Typed reference to a flag's value storage, returned when the flag is registered,
+     * for reading it without a name lookup or type check. Valid for as long as the flag's command
+     * (or FlagSet). References to the value move when a flag of the same type is added to the set.
+     */
+    template<FlagType T>
+    class FlagHandle {
+        private:
+            FlagRef flag_;
+        public:
+            FlagHandle() = default;
+            explicit FlagHandle(FlagRef flag) : flag_(flag) {}
+
+            /**
+             * @brief The current value, by const reference unless small and trivially copyable.
+             */
+            detail::get_result_t<T> get() const { return view(); }
+            /**
+             * @brief The current value, without copying it.
+             */
+            const T& view() const;
+            const T& operator*() const { return view(); }
+            const T* operator->() const { return &view(); }
+            FlagRef flag() const { return flag_; }
+            explicit operator bool() const { return static_cast<bool>(flag_); }
+    };
+
+    /**
+     * @brief Non-owning lookup index over flags.
+     * Flags are kept in a contiguous array sorted by name and hashed into an open addressing
+     * table, so lookups take the same time however many flags are indexed. Single character
+     * shorthands are kept in a 256 entry direct table.
+     */
+    class FlagIndex {
+        private:
+            std::pmr::vector<FlagRef> names_;
+            struct Slot {
+                size_t hash;
+                FlagRef flag;
+            };
+            // power of two sized, at most half full, linearly probed, empty slots have no flag
+            std::pmr::vector<Slot> slots_;
+            // 1-based slots into shorthand_flags_ by shorthand, 0 meaning no flag. Allocated (256 entries)
+            // with the first shorthand, most indexes of a large tree have none
+            std::pmr::vector<std::uint8_t> shorthand_slots_;
+            std::pmr::vector<FlagRef> shorthand_flags_;
+
+            std::pmr::vector<FlagRef>::const_iterator lower_bound(std::string_view) const;
+            static size_t hash(std::string_view name) { return std::hash<std::string_view>()(name); }
+            void insert_slot(size_t hash, FlagRef);
+            void rehash(size_t slot_count);
+        public:
+            explicit FlagIndex(std::pmr::memory_resource* resource = std::pmr::new_delete_resource())
+                : names_(resource), slots_(resource), shorthand_slots_(resource), shorthand_flags_(resource) {}
+            ~FlagIndex() = default;
+
+            bool empty() const;
+            size_t size() const;
+            void clear();
+            std::pmr::vector<FlagRef>::const_iterator begin() const;
+            std::pmr::vector<FlagRef>::const_iterator end() const;
+
+            /**
+             * @brief Indexes a flag by its name and shorthand. The flag's set must outlive the index.
+             *
+             * @param flag the flag to index
+             * @return true if successful, false if the name or shorthand is already indexed
+             */
+            bool insert(FlagRef);
+            /**
+             * @brief Whether a flag with this name and shorthand could be inserted.
+             */
+            bool accepts(std::string_view name, std::string_view shorthand) const;
+            /**
+             * @brief Rebuilds the index from flags given in order of precedence, earlier flags
+             * shadowing later ones with the same name. The flags' sets must outlive the index.
+             *
+             * @param flags the flags to index
+             */
+            void assign(std::span<const FlagRef>);
+            FlagRef find_name(std::string_view) const;
+            FlagRef find_shorthand(char) const;
+            /**
+             * @brief Looks up a shorthand if the name is one character long, a long name otherwise.
+             *
+             * @return the flag if found, a null FlagRef otherwise
+             */
+            FlagRef find(std::string_view) const;
+    };
+
     class FlagSet {
         private:
-            std::map<std::string, std::shared_ptr<Flag>> flags_;
-            std::map<std::string, std::shared_ptr<Flag>> shorthands_;
-            std::map<std::string, std::string> long_to_short_;
+            struct Info {
+                std::string name;
+                std::string shorthand;
+                std::string description;
+                std::uint8_t kind;
+                std::uint32_t slot;
+            };
+            struct CustomFlag {
+                std::unique_ptr<Flag, detail::ArenaDeleter> flag;
+                std::uint32_t id;
+            };
+            std::pmr::memory_resource* resource_;
+            // by id
+            std::pmr::vector<Info> infos_;
+            // allocated with the first flag of a built-in type
+            std::unique_ptr<detail::FlagColumns, detail::ArenaDeleter> columns_;
+            // by slot
+            std::pmr::vector<CustomFlag> custom_;
+            FlagIndex index_;
+
+            friend class FlagRef;
+            template<FlagType> friend class FlagHandle;
 
+            template<typename T, typename... Args>
+            std::unique_ptr<T, detail::ArenaDeleter> make(Args&&...);
+            template<typename T>
+            detail::FlagColumn<T>& column() { return std::get<detail::flag_kind<T>>(columns_->columns); }
             /**
-             * @brief Helper function checking Flag existence in flag map.
-             * 
-             * @param map the map to check in
-             * @param name the name to check for
-             * @return Flag* to the flag if found, nullptr otherwise
+             * @brief Calls `f` with the column of the built-in flag kind `kind`.
              */
-            static Flag* find_in_map(
-                const std::map<std::string, std::shared_ptr<Flag>>&,
-                const std::string&
-            );
+            template<size_t Kind = 0, typename F>
+            decltype(auto) visit_column(std::uint8_t kind, F&& f);
+            /**
+             * @brief Calls `f` with every column, if any flag of a built-in type was added.
+             */
+            template<typename F>
+            void for_each_column(F&& f);
+            /**
+             * @brief The value of the flag of type `T` in `slot`, with no type check.
+             */
+            template<FlagType T>
+            const T& value(std::uint32_t slot);
+            FlagRef ref(std::uint32_t id);
         public:
-            FlagSet() = default;            
+            /**
+             * @brief Copy of the values of the flags of a FlagSet, see capture.
+             */
+            class Values {
+                private:
+                    friend class FlagSet;
+                    detail::CapturedColumns builtin_;
+                    std::vector<std::unique_ptr<Flag>> custom_;
+                public:
+                    /**
+                     * @brief The captured value of `flag`, a flag of the captured set.
+                     *
+                     * @return std::optional<T> the value if captured and of type `T`, nullopt otherwise
+                     */
+                    template<FlagType T>
+                    std::optional<T> get(FlagRef flag) const;
+            };
+
+            /**
+             * @brief Constructs an empty FlagSet
+             *
+             * @param resource (optionally) the memory resource flags are allocated from, which must
+             * outlive the FlagSet. Flags allocated from it are destroyed but never deallocated, as for
+             * arenas like std::pmr::monotonic_buffer_resource.
+             */
+            explicit FlagSet(std::pmr::memory_resource* resource = nullptr)
+                : resource_(resource),
+                  infos_(resource ? resource : std::pmr::new_delete_resource()),
+                  custom_(resource ? resource : std::pmr::new_delete_resource()),
+                  index_(resource ? resource : std::pmr::new_delete_resource()) {}
             ~FlagSet() = default;
+            // FlagRefs point to the set
+            FlagSet(FlagSet const&) = delete;
+            FlagSet& operator=(FlagSet const&) = delete;
 
             bool empty() const;
             size_t size() const;
 
             /**
              * @brief Adds a new flag of type `T` to the flagset
-             * 
-             * @tparam T 
-             * @param name the name of the flag 
+             *
+             * @tparam T
+             * @param name the name of the flag
              * @param description the description of the flag
              * @param defaultVal the default value of the flag
              * @param shorthand (optionally) the shorthand of the flag
-             * @return true if successful, false if name already exists 
+             * @return true if successful, false if name or shorthand already exists
              */
             template<FlagType T>
             bool addFlag(
@@ -146,107 +959,369 @@ namespace pnt_cli {
                 const std::string& = ""
             );
             /**
-             * @brief Checks in either of the flagset maps depending on the size of the flag name.
-             * 
+             * @brief Checks the shorthand table or the name index depending on the size of the flag name.
+             *
              * @param name the name to check for
-             * @return Flag* to the flag if found, nullptr otherwise
+             * @return the flag if found, a null FlagRef otherwise
+             */
+            FlagRef find_simple(std::string_view) const;
+            /**
+             * @brief The index over the flags of this set, iterable in name order.
              */
-            Flag* find_simple(const std::string&) const;            
+            const FlagIndex& index() const;
             /**
              * @brief Checks if a flag of type `T` exists
-             * 
+             *
              * @tparam T the type of the flag to check for
              * @param name the name of the flag to check for
-             * @return FlagImpl<T>* to the flag if found, nullptr if not or if the flag is not of type `T`
+             * @return the flag if found, a null FlagRef if not or if the flag is not of type `T`
              */
             template<FlagType T>
-            FlagImpl<T>* find(const std::string&) const;
+            FlagRef find(std::string_view) const;
 
             /**
              * @brief Gets the current value of a flag of type `T`
-             * 
+             *
              * @tparam T the type of the flag to get
              * @param name the name of the flag to get
              * @return std::optional<T> the value of the flag if found, nullopt otherwise
              */
             template<FlagType T>
-            std::optional<T> get(const std::string&) const;
+            std::optional<T> get(std::string_view) const;
+            /**
+             * @brief Like get, without copying the value.
+             *
+             * @return const T* to the value of the flag if found and of type `T`, nullptr otherwise.
+             * Values of built-in types move when a flag of the same type is added to the set.
+             */
+            template<FlagType T>
+            const T* getIf(std::string_view) const;
 
 
             /**
              * @brief Sets the value of a flag of type `T`
-             * 
-             * @tparam T 
+             *
+             * @tparam T
              * @param name the name of the flag to set
              * @param val the value to set the flag to
              * @return true if successful, false otherwise
              */
             template<FlagType T>
-            bool set(const std::string&, const std::string&);
+            bool set(std::string_view, const std::string&);
+            /**
+             * @brief Resets all flags of the set to their default values
+             */
+            void reset();
+            /**
+             * @brief Converts every flag value of the set whose conversion was deferred to its first read.
+             *
+             * @return the first flag whose value does not convert, a null FlagRef if all do
+             */
+            FlagRef validate(ConversionError* = nullptr) const;
+            /**
+             * @brief Copies the values of all flags of the set. std::string_view values are copied
+             * rather than viewed and deferred conversions are done, so the copy outlives the tokens
+             * the set was parsed from and can be read from multiple threads.
+             */
+            Values capture() const;
+            /**
+             * @brief Sets the values of all flags to the ones captured in `values`, copying
+             * std::string_view values. Flags added to the set since they were captured are reset.
+             */
+            void restore(const Values&);
 
             friend std::ostream& operator<<(std::ostream&, const FlagSet&);
     };
-    inline Flag* FlagSet::find_in_map(const std::map<std::string, std::shared_ptr<Flag>>& map, const std::string& name) {
-        auto it = map.find(name);
-        if (it == map.end()) {
-            return nullptr;
+
+    inline std::pmr::vector<FlagRef>::const_iterator FlagIndex::lower_bound(std::string_view name) const {
+        return std::lower_bound(names_.begin(), names_.end(), name, [](const FlagRef& flag, std::string_view n) {
+            return flag.name() < n;
+        });
+    }
+    inline bool FlagIndex::empty() const { return names_.empty(); }
+    inline size_t FlagIndex::size() const { return names_.size(); }
+    inline void FlagIndex::clear() {
+        names_.clear();
+        slots_.clear();
+        shorthand_slots_.clear();
+        shorthand_flags_.clear();
+    }
+    inline std::pmr::vector<FlagRef>::const_iterator FlagIndex::begin() const { return names_.begin(); }
+    inline std::pmr::vector<FlagRef>::const_iterator FlagIndex::end() const { return names_.end(); }
+    inline bool FlagIndex::accepts(std::string_view name, std::string_view shorthand) const {
+        if (find_name(name) || shorthand.length() > 1)
+            return false;
+        return shorthand.empty() || (!find_shorthand(shorthand[0]) && shorthand_flags_.size() < 255);
+    }
+    inline bool FlagIndex::insert(FlagRef flag) {
+        const std::string& name = flag.name();
+        const std::string& shorthand = flag.shorthand();
+        if (!accepts(name, shorthand))
+            return false;
+        if (shorthand.length()) {
+            shorthand_flags_.push_back(flag);
+            if (shorthand_slots_.empty()) shorthand_slots_.resize(256);
+            shorthand_slots_[static_cast<unsigned char>(shorthand[0])] = static_cast<std::uint8_t>(shorthand_flags_.size());
+        }
+        names_.insert(lower_bound(name), flag);
+        if (2 * names_.size() > slots_.size())
+            rehash(std::max<size_t>(16, 2 * slots_.size()));
+        else
+            insert_slot(hash(name), flag);
+        return true;
+    }
+    inline void FlagIndex::insert_slot(size_t hash, FlagRef flag) {
+        const size_t mask = slots_.size() - 1;
+        size_t i = hash & mask;
+        while (slots_[i].flag) i = (i + 1) & mask;
+        slots_[i] = Slot{hash, flag};
+    }
+    inline void FlagIndex::rehash(size_t slot_count) {
+        slots_.assign(slot_count, Slot{0, FlagRef()});
+        for (FlagRef flag : names_)
+            insert_slot(hash(flag.name()), flag);
+    }
+    inline void FlagIndex::assign(std::span<const FlagRef> flags) {
+        clear();
+        names_.assign(flags.begin(), flags.end());
+        std::stable_sort(names_.begin(), names_.end(), [](const FlagRef& a, const FlagRef& b) {
+            return a.name() < b.name();
+        });
+        names_.erase(std::unique(names_.begin(), names_.end(), [](const FlagRef& a, const FlagRef& b) {
+            return a.name() == b.name();
+        }), names_.end());
+        rehash(std::max<size_t>(16, std::bit_ceil(2 * names_.size())));
+        for (FlagRef flag : flags) {
+            const std::string& shorthand = flag.shorthand();
+            if (shorthand.length() != 1 || find_shorthand(shorthand[0]) || find_name(flag.name()) != flag ||
+                    shorthand_flags_.size() == 255)
+                continue;
+            shorthand_flags_.push_back(flag);
+            if (shorthand_slots_.empty()) shorthand_slots_.resize(256);
+            shorthand_slots_[static_cast<unsigned char>(shorthand[0])] = static_cast<std::uint8_t>(shorthand_flags_.size());
+        }
+    }
+    inline FlagRef FlagIndex::find_name(std::string_view name) const {
+        if (slots_.empty()) return {};
+        const size_t h = hash(name), mask = slots_.size() - 1;
+        for (size_t i = h & mask; slots_[i].flag; i = (i + 1) & mask)
+            if (slots_[i].hash == h && slots_[i].flag.name() == name)
+                return slots_[i].flag;
+        return {};
+    }
+    inline FlagRef FlagIndex::find_shorthand(char shorthand) const {
+        if (shorthand_slots_.empty()) return {};
+        auto slot = shorthand_slots_[static_cast<unsigned char>(shorthand)];
+        return slot ? shorthand_flags_[slot - 1] : FlagRef();
+    }
+    inline FlagRef FlagIndex::find(std::string_view name) const {
+        return name.length() == 1 ? find_shorthand(name[0]) : find_name(name);
+    }
+
+    template<typename T, typename... Args>
+    inline std::unique_ptr<T, detail::ArenaDeleter> FlagSet::make(Args&&... args) {
+        if (resource_) {
+            std::pmr::polymorphic_allocator<> alloc(resource_);
+            return {alloc.new_object<T>(std::forward<Args>(args)...), {false}};
         }
-        return it->second.get();
+        return {new T(std::forward<Args>(args)...), {true}};
     }
-    inline Flag* FlagSet::find_simple(const std::string& name) const {
-        Flag* f;
-        if (name.length() == 1) { f = find_in_map(shorthands_, name); } 
-        else { f = find_in_map(flags_, name); }
-        return f;
+    template<size_t Kind, typename F>
+    inline decltype(auto) FlagSet::visit_column(std::uint8_t kind, F&& f) {
+        // unrolled into a chain of comparisons on kind, which compilers turn into a jump table
+        if constexpr (Kind + 1 < std::tuple_size_v<decltype(columns_->columns)>)
+            if (kind != Kind)
+                return visit_column<Kind + 1>(kind, std::forward<F>(f));
+        return f(std::get<Kind>(columns_->columns));
     }
-    inline bool FlagSet::empty() const { return flags_.empty(); }
-    inline size_t FlagSet::size() const { return flags_.size(); }
+    template<typename F>
+    inline void FlagSet::for_each_column(F&& f) {
+        if (columns_)
+            std::apply([&f] (auto&... column) { (f(column), ...); }, columns_->columns);
+    }
+    template<FlagType T>
+    inline const T& FlagSet::value(std::uint32_t slot) {
+        if constexpr (detail::BuiltinFlagType<T>)
+            return column<T>().value(slot);
+        else
+            return static_cast<const FlagImpl<T>&>(*custom_[slot].flag).view();
+    }
+    inline FlagRef FlagSet::ref(std::uint32_t id) {
+        return FlagRef(this, id, infos_[id].kind, infos_[id].slot);
+    }
+    inline FlagRef FlagSet::find_simple(std::string_view name) const {
+        return index_.find(name);
+    }
+    inline const FlagIndex& FlagSet::index() const { return index_; }
+    inline void FlagSet::reset() {
+        // one copy per array of built-in values, no per-flag dispatch
+        for_each_column([] (auto& column) { column.reset(); });
+        for (auto& custom : custom_)
+            custom.flag->reset();
+    }
+    inline FlagRef FlagSet::validate(ConversionError* error) const {
+        // only flags of custom types defer conversions
+        for (auto& custom : custom_) {
+            if (auto err = custom.flag->validate(); err != ConversionError::none) {
+                if (error) *error = err;
+                return const_cast<FlagSet*>(this)->ref(custom.id);
+            }
+        }
+        return {};
+    }
+    inline FlagSet::Values FlagSet::capture() const {
+        Values values;
+        const_cast<FlagSet*>(this)->for_each_column([&values] <typename T> (detail::FlagColumn<T>& column) {
+            std::get<detail::flag_kind<T>>(values.builtin_) = column.capture();
+        });
+        values.custom_.reserve(custom_.size());
+        for (auto& custom : custom_)
+            values.custom_.push_back(custom.flag->clone());
+        return values;
+    }
+    inline void FlagSet::restore(const Values& values) {
+        for_each_column([&values] <typename T> (detail::FlagColumn<T>& column) {
+            column.restore(std::get<detail::flag_kind<T>>(values.builtin_));
+        });
+        for (size_t i = 0; i < custom_.size(); i++) {
+            if (i < values.custom_.size()) custom_[i].flag->assign(*values.custom_[i]);
+            else custom_[i].flag->reset();
+        }
+    }
+    template<FlagType T>
+    inline std::optional<T> FlagSet::Values::get(FlagRef flag) const {
+        if constexpr (detail::BuiltinFlagType<T>) {
+            auto& captured = std::get<detail::flag_kind<T>>(builtin_);
+            if (flag.kind() == detail::flag_kind<T> && flag.slot() < captured.size())
+                return T(captured[flag.slot()]);
+        } else if (flag.kind() == detail::custom_flag_kind && flag.slot() < custom_.size()) {
+            if (FlagImpl<T>* value = custom_[flag.slot()]->as<T>())
+                return value->get();
+        }
+        return std::nullopt;
+    }
+    inline bool FlagSet::empty() const { return infos_.empty(); }
+    inline size_t FlagSet::size() const { return infos_.size(); }
     template<FlagType T> inline bool FlagSet::addFlag(
-        const std::string& name, 
+        const std::string& name,
         const std::string& description,
         T defaultVal,
         const std::string& shorthand
     ) {
-        if (find_simple(name)) {
+        if (!index_.accepts(name, shorthand)) {
             return false;
         }
-        auto flag = std::make_shared<FlagImpl<T>>(name, shorthand, description, defaultVal);
-        flags_[name] = flag;
-        if (shorthand != "") {
-            shorthands_[shorthand] = flag;
-            long_to_short_[name] = shorthand;
+        const auto id = static_cast<std::uint32_t>(infos_.size());
+        std::uint32_t slot;
+        if constexpr (detail::BuiltinFlagType<T>) {
+            if (!columns_) columns_ = make<detail::FlagColumns>(resource_ ? resource_ : std::pmr::new_delete_resource());
+            slot = column<T>().add(std::move(defaultVal));
+        } else {
+            slot = static_cast<std::uint32_t>(custom_.size());
+            custom_.push_back(CustomFlag{make<FlagImpl<T>>(std::move(defaultVal)), id});
         }
+        infos_.push_back(Info{name, shorthand, description, detail::flag_kind<T>, slot});
+        index_.insert(ref(id));
         return true;
     }
-    template<FlagType T> inline FlagImpl<T>* FlagSet::find(const std::string& name) const {
-        auto f = find_simple(name);
-        return f && f->typeMatches<T>() ? static_cast<FlagImpl<T>*>(f) : nullptr;
+    template<FlagType T> inline FlagRef FlagSet::find(std::string_view name) const {
+        FlagRef f = find_simple(name);
+        return f && f.typeMatches<T>() ? f : FlagRef();
     }
-    template<FlagType T> inline std::optional<T> FlagSet::get(const std::string& name) const {
-        FlagImpl<T>* f = find<T>(name);
-        return f ? std::make_optional(f->get()) : std::nullopt;
+    template<FlagType T> inline std::optional<T> FlagSet::get(std::string_view name) const {
+        const T* value = getIf<T>(name);
+        return value ? std::make_optional(*value) : std::nullopt;
     }
-    template<FlagType T> inline bool FlagSet::set(const std::string& name, const std::string& val) {
-        FlagImpl<T>* f = find<T>(name);
+    template<FlagType T> inline const T* FlagSet::getIf(std::string_view name) const {
+        FlagRef f = find_simple(name);
+        return f ? f.getIf<T>() : nullptr;
+    }
+    template<FlagType T> inline bool FlagSet::set(std::string_view name, const std::string& val) {
+        FlagRef f = find<T>(name);
         if (!f) {
-            log_m("Tried to set non existent flag: " + name);
+            debug_m("Tried to set non existent flag: ", name);
             return false;
         };
-        f->set(val);
+        f.set(val);
         return true;
     }
     inline std::ostream& operator<<(std::ostream& os, const FlagSet& fs) {
         os << "FlagSet:" << '\n';
         os << "\tFlags:" << '\n';
-        os << '\t' << utils::stringify_indirect_map(fs.flags_);
-        os << "\tShorthands:" << '\n';
-        os << '\t' << utils::stringify_indirect_map(fs.shorthands_);
-        os << "\tLong to short:" << '\n';
-        os << '\t' << utils::stringify_map(fs.long_to_short_);
+        os << "\t{";
+        for (bool first = true; FlagRef flag : fs.index_) {
+            if (!first) os << ", ";
+            os << flag.name() << ": {" << flag.name() << " (" << flag.shorthand() << ") " << flag.description() << "}";
+            first = false;
+        }
+        os << "}" << '\n';
         return os;
     }
+
+    inline const std::string& FlagRef::name() const { return set_->infos_[id_].name; }
+    inline const std::string& FlagRef::shorthand() const { return set_->infos_[id_].shorthand; }
+    inline const std::string& FlagRef::description() const { return set_->infos_[id_].description; }
+    template<FlagType T>
+    inline bool FlagRef::typeMatches() const {
+        if constexpr (detail::BuiltinFlagType<T>)
+            return kind_ == detail::flag_kind<T>;
+        else
+            return kind_ == detail::custom_flag_kind && set_->custom_[slot_].flag->typeMatches<T>();
+    }
+    template<FlagType T>
+    inline const T* FlagRef::getIf() const {
+        return typeMatches<T>() ? &set_->value<T>(slot_) : nullptr;
+    }
+    inline void FlagRef::set(const std::string& str) const {
+        if (kind_ == detail::custom_flag_kind)
+            return set_->custom_[slot_].flag->set(str);
+        set_->visit_column(kind_, [this, &str] (auto& column) { column.set(slot_, str); });
+    }
+    inline ConversionError FlagRef::trySet(std::string_view str) const {
+        if (kind_ == detail::custom_flag_kind)
+            return set_->custom_[slot_].flag->trySet(str);
+        return set_->visit_column(kind_, [this, str] <typename T> (detail::FlagColumn<T>& column) {
+            return tryFromString<T>(str, column.value(slot_));
+        });
+    }
+    inline ConversionError FlagRef::trySetCopy(std::string_view str) const {
+        // built-in values convert as they are set, std::string_view ones view the token like parsed ones do
+        if (kind_ == detail::custom_flag_kind)
+            return set_->custom_[slot_].flag->trySetCopy(str);
+        return trySet(str);
+    }
+    inline void FlagRef::reset() const {
+        if (kind_ == detail::custom_flag_kind)
+            return set_->custom_[slot_].flag->reset();
+        set_->visit_column(kind_, [this] (auto& column) { column.reset(slot_); });
+    }
+    inline std::string FlagRef::defaultString() const {
+        if (kind_ == detail::custom_flag_kind)
+            return set_->custom_[slot_].flag->defaultString();
+        return set_->visit_column(kind_, [this] <typename T> (detail::FlagColumn<T>& column) {
+            return toString<T>(T(column.defaults[slot_]));
+        });
+    }
+    inline std::string FlagRef::typeName() const {
+        if (kind_ == detail::custom_flag_kind)
+            return set_->custom_[slot_].flag->typeName();
+        return set_->visit_column(kind_, [] <typename T> (detail::FlagColumn<T>&) {
+            return detail::type_name<T>();
+        });
+    }
+    inline ConversionError FlagRef::validate() const {
+        return kind_ == detail::custom_flag_kind ? set_->custom_[slot_].flag->validate() : ConversionError::none;
+    }
+    inline std::string_view FlagRef::pendingValue() const {
+        return kind_ == detail::custom_flag_kind ? set_->custom_[slot_].flag->pendingValue() : std::string_view();
+    }
+
+    template<FlagType T>
+    inline const T& FlagHandle<T>::view() const {
+        return flag_.set()->template value<T>(flag_.slot());
+    }
 } // namespace pnt_cli
 
 
 
-#endif // FLAG_HPP_
\ No newline at end of file
+#endif // FLAG_HPP_
@@ -3,8 +3,28 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <iomanip>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <charconv>
+#include <type_traits>
+#include <ctime>
+
+#include <unistd.h>
+
+//!Note: log_m and error_m queue records to a background thread that formats and writes them,
+//!Note: so logging costs the caller a copy of the message into a preallocated ring buffer.
+//!Note: error_m waits for everything queued before it to be written before exiting.
+//!Note: Define PNT_CLI_LOG_SYNC to format and write on the calling thread instead.
+//!Note: Levels below PNT_CLI_LOG_LEVEL are compiled out, see pnt_cli::logging::threshold.
+//!Note: Link with -pthread.
 
 static inline std::string getTime() {
     using namespace std::chrono;
@@ -24,22 +44,329 @@ static inline std::string format_log(
     return log_preamble + message;
     // target << preamble << message << std::endl;
 }
-static inline void log_m(const std::string& msg) {
-    std::cout << format_log(preamble("LOG"), msg);
+
+namespace pnt_cli::logging {
+    /**
+     * @brief Logger formatting and writing records on a background thread.
+     * Producers claim slots of a bounded lock-free MPSC ring buffer (Vyukov's bounded queue,
+     * with a single consumer) and copy their message in, blocking only while the buffer is full.
+     */
+    class AsyncLogger {
+        public:
+            enum class Stream : std::uint8_t { out, err };
+        private:
+            static constexpr size_t capacity = 1024;
+            // messages up to this size are stored in the ring, longer ones spill to the heap
+            static constexpr size_t inline_text = 200;
+
+            struct Record {
+                Stream stream;
+                const char* type;
+                std::time_t time;
+                std::uint32_t length;
+                char text[inline_text];
+                std::string overflow;
+
+                std::string_view message() const {
+                    return length <= inline_text ? std::string_view(text, length) : std::string_view(overflow);
+                }
+            };
+            struct alignas(64) Cell {
+                std::atomic<size_t> sequence;
+                Record record;
+            };
+
+            std::unique_ptr<Cell[]> cells_;
+            alignas(64) std::atomic<size_t> enqueue_pos_{0};
+            // bumped after every enqueue and on stop, waited on by the consumer when idle
+            alignas(64) std::atomic<std::uint32_t> pending_{0};
+            // records written so far, waited on by flush
+            alignas(64) std::atomic<size_t> processed_{0};
+            std::atomic<bool> stopping_{false};
+            // consumer only
+            size_t dequeue_pos_ = 0;
+            std::time_t cached_second_ = -1;
+            char cached_time_[32] = {};
+            size_t cached_time_length_ = 0;
+            std::string batch_;
+            int fds_[2];
+            std::thread consumer_;
+
+            void run();
+            size_t drain();
+            std::string_view format_time(std::time_t);
+            void write_batch(Stream);
+        public:
+            /**
+             * @param out_fd file descriptor of Stream::out
+             * @param err_fd file descriptor of Stream::err
+             */
+            explicit AsyncLogger(int out_fd = STDOUT_FILENO, int err_fd = STDERR_FILENO);
+            /**
+             * @brief Writes all queued records and stops the background thread.
+             */
+            ~AsyncLogger();
+
+            /**
+             * @brief Queues a record, formatted as "[type time]: " followed by the concatenation of `parts`.
+             *
+             * @param type a string with static storage duration
+             */
+            template<typename... Parts>
+            void log(Stream, const char* type, const Parts&... parts);
+            /**
+             * @brief Blocks until every record queued before the call has been written.
+             */
+            void flush();
+
+            AsyncLogger(AsyncLogger const&) = delete;
+            AsyncLogger& operator=(AsyncLogger const&) = delete;
+    };
+    inline AsyncLogger::AsyncLogger(int out_fd, int err_fd)
+        : cells_(std::make_unique<Cell[]>(capacity)), fds_{out_fd, err_fd} {
+        for (size_t i = 0; i < capacity; i++)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        consumer_ = std::thread([this] { run(); });
+    }
+    inline AsyncLogger::~AsyncLogger() {
+        stopping_.store(true);
+        pending_.fetch_add(1, std::memory_order_release);
+        pending_.notify_one();
+        consumer_.join();
+    }
+    template<typename... Parts>
+    inline void AsyncLogger::log(Stream stream, const char* type, const Parts&... parts) {
+        const std::string_view views[] = {std::string_view(parts)...};
+        size_t length = 0;
+        for (auto view : views) length += view.length();
+
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & (capacity - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // full, wait for the consumer to free the slot
+                std::this_thread::yield();
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        Record& record = cell->record;
+        record.stream = stream;
+        record.type = type;
+        record.time = std::time(nullptr);
+        record.length = static_cast<std::uint32_t>(length);
+        if (length <= inline_text) {
+            char* out = record.text;
+            for (auto view : views) out = std::copy(view.begin(), view.end(), out);
+        } else {
+            record.overflow.clear();
+            for (auto view : views) record.overflow += view;
+        }
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        pending_.fetch_add(1, std::memory_order_release);
+        pending_.notify_one();
+    }
+    inline void AsyncLogger::flush() {
+        size_t target = enqueue_pos_.load(std::memory_order_acquire);
+        for (size_t done = processed_.load(std::memory_order_acquire); done < target; done = processed_.load(std::memory_order_acquire))
+            processed_.wait(done);
+    }
+    inline void AsyncLogger::run() {
+        while (true) {
+            std::uint32_t seen = pending_.load(std::memory_order_acquire);
+            if (drain())
+                continue;
+            if (stopping_.load())
+                break;
+            pending_.wait(seen);
+        }
+    }
+    inline size_t AsyncLogger::drain() {
+        size_t count = 0;
+        Stream stream = Stream::out;
+        while (true) {
+            Cell& cell = cells_[dequeue_pos_ & (capacity - 1)];
+            if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+                break;
+            const Record& record = cell.record;
+            // keep the relative order of out and err records
+            if (record.stream != stream) {
+                write_batch(stream);
+                stream = record.stream;
+            }
+            batch_ += '[';
+            batch_ += record.type;
+            batch_ += ' ';
+            batch_ += format_time(record.time);
+            batch_ += "]: ";
+            batch_ += record.message();
+            cell.sequence.store(dequeue_pos_ + capacity, std::memory_order_release);
+            dequeue_pos_++;
+            count++;
+        }
+        write_batch(stream);
+        if (count) {
+            processed_.store(dequeue_pos_, std::memory_order_release);
+            processed_.notify_all();
+        }
+        return count;
+    }
+    inline std::string_view AsyncLogger::format_time(std::time_t time) {
+        if (time != cached_second_) {
+            // same format as getTime(), std::ctime without the trailing newline
+            char buf[32];
+            std::tm tm;
+            ::localtime_r(&time, &tm);
+            cached_time_length_ = std::strftime(buf, sizeof(buf), "%a %b %e %H:%M:%S %Y", &tm);
+            std::copy(buf, buf + cached_time_length_, cached_time_);
+            cached_second_ = time;
+        }
+        return std::string_view(cached_time_, cached_time_length_);
+    }
+    inline void AsyncLogger::write_batch(Stream stream) {
+        int fd = fds_[static_cast<int>(stream)];
+        const char* data = batch_.data();
+        size_t left = batch_.size();
+        while (left) {
+            ssize_t written = ::write(fd, data, left);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            data += written;
+            left -= written;
+        }
+        batch_.clear();
+    }
+
+    /**
+     * @brief The logger behind log_m and error_m, started on first use.
+     */
+    inline AsyncLogger& logger() {
+        static AsyncLogger instance;
+        return instance;
+    }
+} // namespace pnt_cli::logging
+
+namespace pnt_cli::logging {
+    enum class Level { trace, debug, info, warn, error, off };
+
+#ifndef PNT_CLI_LOG_LEVEL
+#ifdef NDEBUG
+#define PNT_CLI_LOG_LEVEL 2
+#else
+#define PNT_CLI_LOG_LEVEL 1
+#endif
+#endif
+    /**
+     * @brief Records below this level are compiled out, arguments and all.
+     * Set with -DPNT_CLI_LOG_LEVEL=<0 (trace) to 5 (off)>, defaults to info with NDEBUG and debug without.
+     */
+    inline constexpr Level threshold = static_cast<Level>(PNT_CLI_LOG_LEVEL);
+    template<Level L>
+    inline constexpr bool enabled = L >= threshold && L != Level::off;
+
+    namespace detail {
+        struct FormattedNumber {
+            char buf[32];
+            size_t length;
+            operator std::string_view() const { return std::string_view(buf, length); }
+        };
+        /**
+         * @brief Formats a log argument: numbers with std::to_chars, bools as true/false,
+         * anything else through its conversion to std::string_view.
+         */
+        template<typename T>
+        inline auto format_arg(const T& arg) {
+            if constexpr (std::is_same_v<T, bool>) {
+                return std::string_view(arg ? "true" : "false");
+            } else if constexpr (std::is_same_v<T, char>) {
+                return std::string_view(&arg, 1);
+            } else if constexpr (std::is_arithmetic_v<T>) {
+                FormattedNumber num;
+                num.length = std::to_chars(num.buf, num.buf + sizeof(num.buf), arg).ptr - num.buf;
+                return num;
+            } else {
+                static_assert(std::is_convertible_v<const T&, std::string_view>, "Log arguments must be arithmetic or convertible to std::string_view");
+                return std::string_view(arg);
+            }
+        }
+        inline const char* level_name(Level level) {
+            switch (level) {
+                case Level::trace: return "TRACE";
+                case Level::debug: return "DEBUG";
+                case Level::info: return "LOG";
+                case Level::warn: return "WARN";
+                case Level::error: return "ERROR";
+                case Level::off: break;
+            }
+            return "";
+        }
+    } // namespace detail
+
+    /**
+     * @brief Logs the concatenation of `args` at level `L`, to stderr from warn up and stdout below.
+     * Arguments are only formatted, and the call only compiled, if `L` is enabled.
+     */
+    template<Level L, typename... Args>
+    inline void log(const Args&... args) {
+        if constexpr (enabled<L>) {
+            constexpr bool to_err = L >= Level::warn;
+#ifdef PNT_CLI_LOG_SYNC
+            std::string msg;
+            ((msg += std::string_view(detail::format_arg(args))), ...);
+            (to_err ? std::cerr : std::cout) << format_log(preamble(detail::level_name(L)), msg);
+#else
+            logger().log(to_err ? AsyncLogger::Stream::err : AsyncLogger::Stream::out,
+                detail::level_name(L), detail::format_arg(args)...);
+#endif
+        }
+    }
+} // namespace pnt_cli::logging
+
+// Front ends, taking message parts formatted (and concatenated without allocating) only if their level is enabled.
+template<typename... Args>
+static inline void debug_m(const Args&... args) {
+    pnt_cli::logging::log<pnt_cli::logging::Level::debug>(args...);
+}
+template<typename... Args>
+static inline void log_m(const Args&... args) {
+    pnt_cli::logging::log<pnt_cli::logging::Level::info>(args...);
+}
+template<typename... Args>
+static inline void warn_m(const Args&... args) {
+    pnt_cli::logging::log<pnt_cli::logging::Level::warn>(args...);
 }
-static inline void error_m(const std::string& msg) {
-    std::cerr << format_log(preamble("ERROR"), msg);
+template<typename... Args>
+[[noreturn]] static inline void error_m(const Args&... args) {
+    pnt_cli::logging::log<pnt_cli::logging::Level::error>(args...);
+#ifndef PNT_CLI_LOG_SYNC
+    if constexpr (pnt_cli::logging::enabled<pnt_cli::logging::Level::error>)
+        pnt_cli::logging::logger().flush();
+#endif
     std::exit(1);
 }
+//!Note: Lines are padded into a single buffer and written with one call, without flushing.
 static inline void print_centered_text(
     std::ostream& target,
     const std::string& text,
     int width = 80,
     char fill = ' '
 ) {
-    target << std::right << std::setfill(fill) << std::setw(width/2) <<
-        text.substr(0, text.length()/2) << std::left << std::setfill(fill) <<
-        std::setw(width/2) << text.substr(text.length()/2) << std::endl;
+    const size_t half = width > 0 ? width / 2 : 0;
+    const size_t left = text.length() / 2, right = text.length() - left;
+    std::string line(half > left ? half - left : 0, fill);
+    line += text;
+    line.append(half > right ? half - right : 0, fill);
+    line += '\n';
+    target.write(line.data(), line.size());
 }
 
 static inline void print_left_right_text(
@@ -49,9 +376,13 @@ static inline void print_left_right_text(
     int width = 80,
     char fill = ' '
 ) {
-    target << std::left << std::setfill(fill) << std::setw(width - right.length()) <<
-        left << std::right << std::setfill(fill) << std::setw(right.length()) <<
-        right << std::endl;
+    const size_t columns = width > 0 ? width : 0;
+    std::string line = left;
+    if (columns > left.length() + right.length())
+        line.append(columns - left.length() - right.length(), fill);
+    line += right;
+    line += '\n';
+    target.write(line.data(), line.size());
 }
 
 #endif // LOG_HPP_
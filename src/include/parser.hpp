@@ -0,0 +1,370 @@
+/**
+ * @file parser.hpp
+ * @author Zografos Orfeas
+ * @brief Single pass argv tokenizer shared by the runtime and the compile-time command trees,
+ * with @response file expansion.
+ * @version 0.1
+ * @date 2022-04-10
+ */
+
+#ifndef PARSER_HPP_
+#define PARSER_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <optional>
+#include <iterator>
+#include <algorithm>
+#include <span>
+#include <ranges>
+#include <stdexcept>
+#include <cstring>
+#include <concepts>
+
+#include <utils.hpp>
+#include <flag.hpp>
+#include <result.hpp>
+
+namespace pnt_cli::detail {
+    /**
+     * @brief A run of consecutive positional args, either argv entries or a stretch of a response file
+     * holding nothing but positional tokens.
+     */
+    struct ArgRun {
+        std::span<char* const> argv;
+        // used when argv is empty
+        std::string_view text;
+    };
+
+    /**
+     * @brief Response files mapped, and positional runs collected, by try_parse_argv.
+     * Must outlive the Args (and any std::string_view flag values) parsed into it.
+     */
+    struct ArgStore {
+        std::vector<utils::MappedFile> files;
+        std::vector<ArgRun> runs;
+
+        void clear() { files.clear(); runs.clear(); }
+    };
+
+    /**
+     * @brief The subset of std::vector ArgStores use, over inline storage of a fixed capacity.
+     */
+    template<typename T, size_t N>
+    class InlineVector {
+        private:
+            std::array<T, N> items_{};
+            size_t size_ = 0;
+        public:
+            bool empty() const { return size_ == 0; }
+            bool full() const { return size_ == N; }
+            size_t size() const { return size_; }
+            T* begin() { return items_.data(); }
+            T* end() { return items_.data() + size_; }
+            const T* begin() const { return items_.data(); }
+            const T* end() const { return items_.data() + size_; }
+            T& back() { return items_[size_ - 1]; }
+            // only when not full
+            T& emplace_back(T&& item) { return items_[size_++] = std::move(item); }
+            void push_back(T&& item) { emplace_back(std::move(item)); }
+            // releases what the items hold, e.g. mappings
+            void clear() {
+                for (T& item : *this) item = T();
+                size_ = 0;
+            }
+            operator std::span<const T>() const { return {items_.data(), size_}; }
+    };
+
+    /**
+     * @brief ArgStore without heap storage, holding up to `Runs` positional runs and `Files` response files.
+     * try_parse_argv fails with ErrorCode::too_many_args when either is exceeded.
+     */
+    template<size_t Runs, size_t Files>
+    struct InlineArgStore {
+        InlineVector<utils::MappedFile, Files> files;
+        InlineVector<ArgRun, Runs> runs;
+
+        void clear() { files.clear(); runs.clear(); }
+    };
+
+    template<typename C>
+    inline bool is_full(const C& items) {
+        if constexpr (requires { items.full(); }) return items.full();
+        else return false;
+    }
+
+    struct Token {
+        // unquoted
+        std::string_view value;
+        // as in the source, quotes included
+        std::string_view raw;
+        // opening quote without a closing one, the token spans the rest of the text
+        bool unterminated = false;
+    };
+
+    /**
+     * @brief Splits the next whitespace separated token off the front of `text`.
+     * A token wrapped in single or double quotes may contain whitespace, there are no escape sequences.
+     *
+     * @return the token, nullopt if only whitespace is left
+     */
+    inline std::optional<Token> next_token(std::string_view& text) {
+        auto is_space = [] (char c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r'; };
+        size_t start = std::find_if_not(text.begin(), text.end(), is_space) - text.begin();
+        if (start == text.size()) {
+            text = {};
+            return std::nullopt;
+        }
+        text.remove_prefix(start);
+        Token token;
+        size_t end;
+        if (text[0] == '"' || text[0] == '\'') {
+            end = text.find(text[0], 1);
+            if (end == std::string_view::npos) {
+                token.unterminated = true;
+                end = text.size() - 1;
+            }
+            token.value = text.substr(1, end - 1);
+            end++;
+        } else {
+            end = std::find_if(text.begin(), text.end(), is_space) - text.begin();
+            token.value = text.substr(0, end);
+        }
+        token.raw = text.substr(0, end);
+        text.remove_prefix(end);
+        return token;
+    }
+} // namespace pnt_cli::detail
+
+namespace pnt_cli {
+    /**
+     * @brief Non-owning, lazy forward range of the positional arguments left after parsing.
+     * Elements are `std::string_view`s straight into argv or into mapped response files, which are
+     * tokenized as the range is iterated, so that no list of all args is ever built.
+     * Valid for as long as argv is, and the action it was passed to runs.
+     */
+    class Args {
+        private:
+            std::span<const detail::ArgRun> runs_;
+        public:
+            class iterator {
+                private:
+                    const detail::ArgRun* run_ = nullptr;
+                    const detail::ArgRun* end_ = nullptr;
+                    // next argv entry, or untokenized rest of the text, of the current run
+                    size_t index_ = 0;
+                    std::string_view rest_;
+                    std::string_view current_;
+
+                    void advance();
+                public:
+                    using value_type = std::string_view;
+                    using difference_type = std::ptrdiff_t;
+                    using iterator_concept = std::forward_iterator_tag;
+
+                    iterator() = default;
+                    explicit iterator(std::span<const detail::ArgRun>);
+
+                    std::string_view operator*() const { return current_; }
+                    iterator& operator++() { advance(); return *this; }
+                    iterator operator++(int) { iterator it = *this; advance(); return it; }
+                    bool operator==(const iterator& other) const {
+                        return run_ == other.run_ && index_ == other.index_ && rest_.data() == other.rest_.data();
+                    }
+                    bool operator==(std::default_sentinel_t) const { return run_ == end_; }
+            };
+
+            Args() = default;
+            explicit Args(std::span<const detail::ArgRun> runs) : runs_(runs) {}
+
+            iterator begin() const { return iterator(runs_); }
+            std::default_sentinel_t end() const { return {}; }
+            // runs are never empty
+            bool empty() const { return runs_.empty(); }
+    };
+    inline Args::iterator::iterator(std::span<const detail::ArgRun> runs)
+        : run_(runs.data()), end_(runs.data() + runs.size()) {
+        if (run_ != end_) rest_ = run_->text;
+        advance();
+    }
+    inline void Args::iterator::advance() {
+        while (run_ != end_) {
+            if (!run_->argv.empty()) {
+                if (index_ < run_->argv.size()) {
+                    current_ = run_->argv[index_++];
+                    return;
+                }
+            } else if (auto token = detail::next_token(rest_)) {
+                current_ = token->value;
+                return;
+            }
+            if (++run_ != end_) {
+                index_ = 0;
+                rest_ = run_->text;
+            }
+        }
+        index_ = 0;
+        rest_ = {};
+    }
+    static_assert(std::ranges::forward_range<Args>);
+} // namespace pnt_cli
+
+namespace pnt_cli::detail {
+    /**
+     * @brief What try_parse_argv needs from a command tree.
+     * `find_flag` looks up a flag visible to the command reached so far (nullptr-like if unknown),
+     * `set` converts a flag value without throwing on malformed input,
+     * `enter` dispatches to a direct subcommand and returns whether one was found.
+     */
+    template<typename P>
+    concept ArgvParser = requires (P p, std::string_view sv) {
+        { p.find_flag(sv) };
+        { p.is_bool(p.find_flag(sv)) } -> std::same_as<bool>;
+        { p.set(p.find_flag(sv), sv) } -> std::same_as<ConversionError>;
+        { p.enter(sv) } -> std::same_as<bool>;
+    };
+
+    /**
+     * @brief Parses the flag token `arg` (and its value if it is a separate token) and sets it.
+     * Accepts `--name=value`, `--name value`, `--name` (bool), `-x`, `-x value` and `-xVALUE`.
+     *
+     * @param index the argv index reported in errors
+     * @param next returns the next token, nullopt if there is none
+     */
+    template<ArgvParser P, typename Next>
+    inline Error consume_flag(P& parser, std::string_view arg, int index, Next&& next) {
+        std::string_view flag_name;
+        std::optional<std::string_view> flag_value;
+        if (arg.starts_with("--")) {
+            flag_name = arg.substr(2);
+            if (auto eq = flag_name.find('='); eq != std::string_view::npos) {
+                flag_value = flag_name.substr(eq + 1);
+                flag_name = flag_name.substr(0, eq);
+            }
+            if (flag_name.length() <= 1)
+                return Error{ErrorCode::invalid_flag_name, index, std::string(arg)};
+        } else {
+            flag_name = arg.substr(1, 1);
+            if (arg.length() > 2)
+                flag_value = arg.substr(2);
+        }
+        auto flag = parser.find_flag(flag_name);
+        if (!flag)
+            return Error{ErrorCode::unknown_flag, index, std::string(arg)};
+        if (!flag_value) {
+            if (parser.is_bool(flag)) {
+                flag_value = "true";
+            } else if (std::optional<Token> token = next()) {
+                flag_value = token->value;
+            } else {
+                return Error{ErrorCode::missing_value, index, std::string(arg)};
+            }
+        }
+        switch (parser.set(flag, *flag_value)) {
+            case ConversionError::none: return Error{};
+            case ConversionError::out_of_range:
+                return Error{ErrorCode::out_of_range, index, std::string(arg), std::string(*flag_value)};
+            default:
+                return Error{ErrorCode::invalid_value, index, std::string(arg), std::string(*flag_value)};
+        }
+    }
+
+    //!Note positional args given in argv are compacted in place at the front of argv (after argv[0])
+    //!Note response files are tokenized twice: once here, and again lazily when Args are iterated
+    /**
+     * @brief Walks argv once, setting flags and dispatching down the subcommand tree as it goes.
+     * Flags are accepted anywhere, `--` ends flag parsing. Subcommands are only recognized
+     * before the first positional arg. An `@path` arg is replaced by the whitespace separated
+     * tokens of the file at `path`, which is memory mapped into `store` (response files can't nest).
+     * Positional args are collected into `store`, to be viewed as Args(store.runs).
+     *
+     * @param store an ArgStore, or an InlineArgStore
+     * @return the first error, stopping the parse, or an Error with code none
+     */
+    template<ArgvParser P, typename Store>
+    inline Error try_parse_argv(P& parser, int argc, char** argv, Store& store) {
+        char** out = argv + std::min(argc, 1);
+        int i = 1;
+        // untokenized rest of the response file being expanded, and the index of its @path arg
+        std::string_view file;
+        int file_index = 0;
+        bool in_file = false;
+        bool flags_done = false;
+        // whether the next positional continues the last run
+        bool run_open = false;
+        auto next = [&] () -> std::optional<Token> {
+            if (in_file) {
+                if (auto token = next_token(file)) return token;
+                in_file = run_open = false;
+            }
+            if (i < argc) {
+                std::string_view arg = argv[i++];
+                return Token{arg, arg};
+            }
+            return std::nullopt;
+        };
+        while (std::optional<Token> token = next()) {
+            std::string_view arg = token->value;
+            int index = in_file ? file_index : i - 1;
+            if (token->unterminated)
+                return Error{ErrorCode::unterminated_quote, index, std::string(token->raw.substr(0, 32))};
+            if (!flags_done) {
+                if (arg == "--") {
+                    flags_done = true;
+                    run_open = false;
+                    continue;
+                }
+                if (!in_file && arg.length() > 1 && arg[0] == '@') {
+                    if (is_full(store.files))
+                        return Error{ErrorCode::too_many_args, index, std::string(arg)};
+                    utils::MappedFile mapped;
+                    // argv entries are NUL terminated
+                    if (int err = mapped.open(arg.data() + 1))
+                        return Error{ErrorCode::file_error, index, std::string(arg.substr(1)), std::strerror(err)};
+                    file = store.files.emplace_back(std::move(mapped)).view();
+                    file_index = index;
+                    in_file = true;
+                    run_open = false;
+                    continue;
+                }
+                if (arg.length() > 1 && arg[0] == '-') {
+                    if (Error err = consume_flag(parser, arg, index, next))
+                        return err;
+                    run_open = false;
+                    continue;
+                }
+                if (store.runs.empty() && parser.enter(arg))
+                    continue;
+            }
+            if (in_file) {
+                if (run_open) {
+                    auto& text = store.runs.back().text;
+                    text = std::string_view(text.data(), token->raw.data() + token->raw.size() - text.data());
+                } else {
+                    if (is_full(store.runs))
+                        return Error{ErrorCode::too_many_args, index, std::string(token->raw.substr(0, 32))};
+                    store.runs.push_back(ArgRun{{}, token->raw});
+                }
+            } else {
+                *out = argv[i - 1];
+                // compacted argv positionals are contiguous, so flags between them don't end the run,
+                // keeping the runs (and their allocations) independent of argc
+                auto* last = store.runs.empty() ? nullptr : &store.runs.back().argv;
+                if (last && !last->empty() && last->data() + last->size() == out) {
+                    *last = std::span<char* const>(last->data(), last->size() + 1);
+                } else {
+                    if (is_full(store.runs))
+                        return Error{ErrorCode::too_many_args, index, std::string(arg)};
+                    store.runs.push_back(ArgRun{std::span<char* const>(out, 1), {}});
+                }
+                out++;
+            }
+            run_open = true;
+        }
+        return Error{};
+    }
+} // namespace pnt_cli::detail
+
+#endif // PARSER_HPP_
@@ -0,0 +1,138 @@
+/**
+ * @file result.hpp
+ * @author Zografos Orfeas
+ * @brief Error values for the exception-free (try*) API.
+ * @version 0.1
+ * @date 2022-04-20
+ */
+
+#ifndef RESULT_HPP_
+#define RESULT_HPP_
+
+#include <string>
+#include <string_view>
+#include <variant>
+#include <utility>
+
+#include <utils.hpp>
+
+namespace pnt_cli {
+    enum class ErrorCode {
+        none,
+        invalid_flag_name,      // `--x` style token with a one character name
+        unknown_flag,           // no flag with that name visible to the command reached
+        missing_value,          // non bool flag last on the command line
+        invalid_value,          // flag value not a representation of the flag's type
+        out_of_range,           // flag value not in the flag's type's range
+        unterminated_quote,     // in a response file
+        file_error,             // response file could not be mapped
+        name_conflict,          // flag, subcommand or alias name already taken
+        invalid_shorthand,      // shorthand longer than one character
+        no_action,              // command reached has no action to invoke
+        too_many_args           // more positional runs or response files than inline argument storage holds
+    };
+    inline const char* errorCodeMessage(ErrorCode code) {
+        switch (code) {
+            case ErrorCode::none: return "no error";
+            case ErrorCode::invalid_flag_name: return "invalid flag name";
+            case ErrorCode::unknown_flag: return "unknown flag";
+            case ErrorCode::missing_value: return "missing value";
+            case ErrorCode::invalid_value: return "invalid value";
+            case ErrorCode::out_of_range: return "value out of range";
+            case ErrorCode::unterminated_quote: return "unterminated quote";
+            case ErrorCode::file_error: return "could not open file";
+            case ErrorCode::name_conflict: return "name already exists";
+            case ErrorCode::invalid_shorthand: return "invalid shorthand";
+            case ErrorCode::no_action: return "command has no action";
+            case ErrorCode::too_many_args: return "too many positional runs or response files";
+        }
+        return "unknown error";
+    }
+
+    /**
+     * @brief What went wrong, where.
+     */
+    struct Error {
+        ErrorCode code = ErrorCode::none;
+        // index of the offending token in the original argv (of the @file arg for tokens of a response file),
+        // -1 if the error is not about a token
+        int index = -1;
+        // the offending token, or name for registration errors
+        std::string token;
+        // the flag value for conversion errors, the system error for file errors
+        std::string detail;
+        // names of the commands from the root to the one the error occurred in, space separated
+        std::string command;
+
+        explicit operator bool() const { return code != ErrorCode::none; }
+        /**
+         * @brief A human readable description of the error.
+         */
+        std::string message() const;
+    };
+    inline std::string Error::message() const {
+        std::string msg = errorCodeMessage(code);
+        if (!token.empty()) msg += ": " + token;
+        if (!detail.empty()) msg += ": " + detail;
+        if (!command.empty()) msg += " (in " + command + ")";
+        return msg;
+    }
+
+    /**
+     * @brief Either a value or the Error that prevented producing it.
+     */
+    template<typename T>
+    class [[nodiscard]] Result {
+        private:
+            std::variant<T, Error> value_;
+        public:
+            Result(T value) : value_(std::in_place_index<0>, std::move(value)) {}
+            Result(Error error) : value_(std::in_place_index<1>, std::move(error)) {}
+
+            bool has_value() const { return value_.index() == 0; }
+            explicit operator bool() const { return has_value(); }
+            /**
+             * @brief The value, raising the error if there is none.
+             */
+            T& value() &;
+            const T& value() const&;
+            T&& value() &&;
+            const Error& error() const { return std::get<1>(value_); }
+
+            T& operator*() { return std::get<0>(value_); }
+            const T& operator*() const { return std::get<0>(value_); }
+            T* operator->() { return &std::get<0>(value_); }
+            const T* operator->() const { return &std::get<0>(value_); }
+    };
+    template<typename T> inline T& Result<T>::value() & {
+        if (!has_value()) utils::raise(error().message());
+        return std::get<0>(value_);
+    }
+    template<typename T> inline const T& Result<T>::value() const& {
+        if (!has_value()) utils::raise(error().message());
+        return std::get<0>(value_);
+    }
+    template<typename T> inline T&& Result<T>::value() && {
+        if (!has_value()) utils::raise(error().message());
+        return std::get<0>(std::move(value_));
+    }
+
+    template<>
+    class [[nodiscard]] Result<void> {
+        private:
+            Error error_;
+        public:
+            Result() = default;
+            Result(Error error) : error_(std::move(error)) {}
+
+            bool has_value() const { return !error_; }
+            explicit operator bool() const { return has_value(); }
+            /**
+             * @brief Raises the error if there is one.
+             */
+            void value() const { if (error_) utils::raise(error_.message()); }
+            const Error& error() const { return error_; }
+    };
+} // namespace pnt_cli
+
+#endif // RESULT_HPP_
@@ -0,0 +1,470 @@
+/**
+ * @file schema.hpp
+ * @author Zografos Orfeas
+ * @brief Compile-time command/flag schemas with constexpr generated parse tables.
+ * @version 0.1
+ * @date 2022-04-10
+ */
+
+#ifndef SCHEMA_HPP_
+#define SCHEMA_HPP_
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <tuple>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include <flag.hpp>
+#include <parser.hpp>
+#include <result.hpp>
+
+//!Note: A schema is declared as a constexpr variable with static storage duration, e.g.
+//!Note:     static constexpr auto tool = schema::command("tool", "Does things",
+//!Note:         schema::flags(schema::persistentFlag<bool>("verbose", "Be chatty", false, 'v')),
+//!Note:         schema::subcommands(
+//!Note:             schema::command("build", "Builds things", schema::flags(schema::flag<int>("jobs", "Parallelism", 1, 'j')))
+//!Note:         ));
+//!Note:     schema::Cli<tool> cli;
+//!Note: Name and shorthand conflicts fail to compile when schema::Cli is instantiated.
+
+namespace pnt_cli::schema {
+    /**
+     * @brief String literal usable as a template argument, e.g. `cli.get<"jobs", "build">()`.
+     */
+    template<size_t N>
+    struct fixed_string {
+        char data[N]{};
+        consteval fixed_string(const char (&str)[N]) { std::copy_n(str, N, data); }
+        constexpr std::string_view view() const { return {data, N - 1}; }
+    };
+
+    //!Note std::string flags are stored as std::string_view into argv (or the default literal)
+    template<FlagType T>
+    using value_t = std::conditional_t<std::same_as<T, std::string>, std::string_view, T>;
+
+    template<FlagType T>
+    struct FlagSpec {
+        using type = T;
+        std::string_view name;
+        std::string_view description;
+        value_t<T> default_value;
+        char shorthand;
+        bool persistent;
+    };
+
+    template<typename Flags, typename Subcommands>
+    struct CommandSpec {
+        std::string_view name;
+        std::string_view description;
+        Flags flags;
+        Subcommands subcommands;
+    };
+
+    template<FlagType T>
+    consteval FlagSpec<T> flag(
+        std::string_view name,
+        std::string_view description,
+        value_t<T> default_value,
+        char shorthand = '\0'
+    ) {
+        return {name, description, default_value, shorthand, false};
+    }
+    template<FlagType T>
+    consteval FlagSpec<T> persistentFlag(
+        std::string_view name,
+        std::string_view description,
+        value_t<T> default_value,
+        char shorthand = '\0'
+    ) {
+        return {name, description, default_value, shorthand, true};
+    }
+    template<typename... Flags>
+    consteval std::tuple<Flags...> flags(Flags... fs) { return {fs...}; }
+    template<typename... Commands>
+    consteval std::tuple<Commands...> subcommands(Commands... cmds) { return {cmds...}; }
+    template<typename Flags = std::tuple<>, typename Subcommands = std::tuple<>>
+    consteval CommandSpec<Flags, Subcommands> command(
+        std::string_view name,
+        std::string_view description,
+        Flags fs = {},
+        Subcommands cmds = {}
+    ) {
+        return {name, description, fs, cmds};
+    }
+
+    namespace detail {
+        inline constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        struct CommandEntry {
+            std::string_view name;
+            std::string_view description;
+            size_t parent;
+            size_t flags_begin;
+            size_t flags_end;
+        };
+        struct FlagEntry {
+            std::string_view name;
+            char shorthand;
+            bool persistent;
+            bool is_bool;
+            size_t index;
+            size_t command;
+        };
+        struct VisibleEntry {
+            std::string_view name;
+            char shorthand;
+            size_t flag;
+        };
+        struct ChildEntry {
+            std::string_view name;
+            size_t command;
+        };
+
+        template<typename F, typename S>
+        constexpr size_t count_commands(const CommandSpec<F, S>& cmd) {
+            return std::apply([](const auto&... subs) {
+                return (size_t{1} + ... + count_commands(subs));
+            }, cmd.subcommands);
+        }
+        /**
+         * @brief Collects the flag specs of the whole tree in pre-order into a single tuple.
+         */
+        template<typename F, typename S>
+        constexpr auto flatten_flags(const CommandSpec<F, S>& cmd) {
+            return std::apply([&](const auto&... subs) {
+                return std::tuple_cat(cmd.flags, flatten_flags(subs)...);
+            }, cmd.subcommands);
+        }
+        template<size_t N, typename F, typename S>
+        constexpr void collect_commands(
+            const CommandSpec<F, S>& cmd,
+            size_t parent,
+            std::array<CommandEntry, N>& out,
+            size_t& next_command,
+            size_t& next_flag
+        ) {
+            size_t self = next_command++;
+            out[self] = {cmd.name, cmd.description, parent, next_flag, next_flag + std::tuple_size_v<F>};
+            next_flag += std::tuple_size_v<F>;
+            std::apply([&](const auto&... subs) {
+                (collect_commands(subs, self, out, next_command, next_flag), ...);
+            }, cmd.subcommands);
+        }
+
+        template<auto const& Spec>
+        struct ParseTables {
+            static constexpr auto flag_specs = flatten_flags(Spec);
+            using flag_specs_type = std::remove_cvref_t<decltype(flag_specs)>;
+            static constexpr size_t command_count = count_commands(Spec);
+            static constexpr size_t flag_count = std::tuple_size_v<flag_specs_type>;
+
+            static constexpr auto defaults() {
+                return std::apply([](const auto&... fs) {
+                    return std::tuple<value_t<typename std::remove_cvref_t<decltype(fs)>::type>...>(fs.default_value...);
+                }, flag_specs);
+            }
+            using values_type = decltype(defaults());
+
+            static constexpr std::array<CommandEntry, command_count> commands = [] {
+                std::array<CommandEntry, command_count> out{};
+                size_t next_command = 0, next_flag = 0;
+                collect_commands(Spec, npos, out, next_command, next_flag);
+                return out;
+            }();
+            static constexpr std::array<FlagEntry, flag_count> flags = [] {
+                std::array<FlagEntry, flag_count> out{};
+                size_t i = 0;
+                std::apply([&](const auto&... fs) {
+                    ((out[i] = {fs.name, fs.shorthand, fs.persistent,
+                        std::same_as<typename std::remove_cvref_t<decltype(fs)>::type, bool>, i, 0}, i++), ...);
+                }, flag_specs);
+                for (size_t c = 0; c < command_count; c++)
+                    for (size_t f = commands[c].flags_begin; f < commands[c].flags_end; f++)
+                        out[f].command = c;
+                return out;
+            }();
+
+            static constexpr bool is_ancestor_or_self(size_t ancestor, size_t cmd) {
+                for (; cmd != npos; cmd = commands[cmd].parent)
+                    if (cmd == ancestor) return true;
+                return false;
+            }
+            static constexpr bool is_visible(const FlagEntry& flag, size_t cmd) {
+                return flag.command == cmd || (flag.persistent && is_ancestor_or_self(flag.command, cmd));
+            }
+            static constexpr size_t visible_count = [] {
+                size_t count = 0;
+                for (size_t c = 0; c < command_count; c++)
+                    for (const auto& flag : flags)
+                        count += is_visible(flag, c);
+                return count;
+            }();
+            // Flags visible to each command (its own plus persistent ones of its ancestors),
+            // command c owning [visible_offsets[c], visible_offsets[c + 1])
+            static constexpr std::array<size_t, command_count + 1> visible_offsets = [] {
+                std::array<size_t, command_count + 1> out{};
+                for (size_t c = 0; c < command_count; c++) {
+                    out[c + 1] = out[c];
+                    for (const auto& flag : flags)
+                        out[c + 1] += is_visible(flag, c);
+                }
+                return out;
+            }();
+            static constexpr auto make_visible(bool by_name) {
+                std::array<VisibleEntry, visible_count> out{};
+                for (size_t c = 0, i = 0; c < command_count; c++) {
+                    for (const auto& flag : flags)
+                        if (is_visible(flag, c))
+                            out[i++] = {flag.name, flag.shorthand, flag.index};
+                    std::sort(out.begin() + visible_offsets[c], out.begin() + i, [by_name](const auto& a, const auto& b) {
+                        return by_name ? a.name < b.name : a.shorthand < b.shorthand;
+                    });
+                }
+                return out;
+            }
+            static constexpr std::array<VisibleEntry, visible_count> visible_by_name = make_visible(true);
+            static constexpr std::array<VisibleEntry, visible_count> visible_by_shorthand = make_visible(false);
+
+            // Direct subcommands of each command sorted by name,
+            // command c owning [children_offsets[c], children_offsets[c + 1])
+            static constexpr std::array<size_t, command_count + 1> children_offsets = [] {
+                std::array<size_t, command_count + 1> out{};
+                for (size_t c = 0; c < command_count; c++) {
+                    out[c + 1] = out[c];
+                    for (const auto& cmd : commands)
+                        out[c + 1] += cmd.parent == c;
+                }
+                return out;
+            }();
+            static constexpr std::array<ChildEntry, command_count> children = [] {
+                std::array<ChildEntry, command_count> out{};
+                for (size_t c = 0, i = 0; c < command_count; c++) {
+                    for (size_t sub = 0; sub < command_count; sub++)
+                        if (commands[sub].parent == c)
+                            out[i++] = {commands[sub].name, sub};
+                    std::sort(out.begin() + children_offsets[c], out.begin() + i, [](const auto& a, const auto& b) {
+                        return a.name < b.name;
+                    });
+                }
+                return out;
+            }();
+
+            static constexpr bool flag_names_valid = [] {
+                for (const auto& flag : flags)
+                    if (flag.name.length() <= 1) return false;
+                return true;
+            }();
+            static constexpr bool flag_names_unique = [] {
+                for (size_t c = 0; c < command_count; c++)
+                    for (size_t i = visible_offsets[c] + 1; i < visible_offsets[c + 1]; i++)
+                        if (visible_by_name[i - 1].name == visible_by_name[i].name) return false;
+                return true;
+            }();
+            static constexpr bool shorthands_unique = [] {
+                for (size_t c = 0; c < command_count; c++)
+                    for (size_t i = visible_offsets[c] + 1; i < visible_offsets[c + 1]; i++)
+                        if (visible_by_shorthand[i].shorthand &&
+                                visible_by_shorthand[i - 1].shorthand == visible_by_shorthand[i].shorthand)
+                            return false;
+                return true;
+            }();
+            static constexpr bool subcommands_unique = [] {
+                for (size_t c = 0; c < command_count; c++)
+                    for (size_t i = children_offsets[c] + 1; i < children_offsets[c + 1]; i++)
+                        if (children[i - 1].name == children[i].name) return false;
+                return true;
+            }();
+
+            static constexpr size_t find_flag(size_t cmd, std::string_view name) {
+                auto first = visible_by_name.begin() + visible_offsets[cmd];
+                auto last = visible_by_name.begin() + visible_offsets[cmd + 1];
+                auto it = std::lower_bound(first, last, name, [](const auto& e, std::string_view n) {
+                    return e.name < n;
+                });
+                return it != last && it->name == name ? it->flag : npos;
+            }
+            static constexpr size_t find_shorthand(size_t cmd, char shorthand) {
+                auto first = visible_by_shorthand.begin() + visible_offsets[cmd];
+                auto last = visible_by_shorthand.begin() + visible_offsets[cmd + 1];
+                auto it = std::lower_bound(first, last, shorthand, [](const auto& e, char s) {
+                    return e.shorthand < s;
+                });
+                return shorthand && it != last && it->shorthand == shorthand ? it->flag : npos;
+            }
+            static constexpr size_t find_subcommand(size_t cmd, std::string_view name) {
+                auto first = children.begin() + children_offsets[cmd];
+                auto last = children.begin() + children_offsets[cmd + 1];
+                auto it = std::lower_bound(first, last, name, [](const auto& e, std::string_view n) {
+                    return e.name < n;
+                });
+                return it != last && it->name == name ? it->command : npos;
+            }
+            /**
+             * @brief Resolves a space separated path of subcommand names, "" being the root.
+             */
+            static constexpr size_t find_command(std::string_view path) {
+                size_t cmd = 0;
+                while (cmd != npos && !path.empty()) {
+                    auto space = path.find(' ');
+                    cmd = find_subcommand(cmd, path.substr(0, space));
+                    path = space == std::string_view::npos ? std::string_view{} : path.substr(space + 1);
+                }
+                return cmd;
+            }
+
+            template<size_t I>
+            static ConversionError set_value(values_type& values, std::string_view token) {
+                using T = typename std::tuple_element_t<I, flag_specs_type>::type;
+                if constexpr (std::same_as<T, std::string>) {
+                    std::get<I>(values) = token;
+                    return ConversionError::none;
+                } else {
+                    return tryFromString<T>(token, std::get<I>(values));
+                }
+            }
+            using setter_t = ConversionError(*)(values_type&, std::string_view);
+            static constexpr std::array<setter_t, flag_count> setters = []<size_t... I>(std::index_sequence<I...>) {
+                return std::array<setter_t, flag_count>{&set_value<I>...};
+            }(std::make_index_sequence<flag_count>{});
+        };
+    } // namespace detail
+
+    /**
+     * @brief Checks a schema for conflicts without failing compilation.
+     */
+    template<auto const& Spec>
+    inline constexpr bool is_valid =
+        detail::ParseTables<Spec>::flag_names_valid &&
+        detail::ParseTables<Spec>::flag_names_unique &&
+        detail::ParseTables<Spec>::shorthands_unique &&
+        detail::ParseTables<Spec>::subcommands_unique;
+
+    /**
+     * @brief Parser and flag value storage for a compile-time schema.
+     * All lookup tables are constexpr, values live inline (std::string flags as views), built-in types
+     * are converted straight from argv and positional runs and response files are kept inline, so
+     * constructing a Cli and parsing argv allocates nothing. Conversions of custom flag types and errors
+     * may allocate.
+     * Positionals given in argv form a single run, a response file adds a run per stretch of positionals
+     * between its flags. Parsing fails with ErrorCode::too_many_args beyond `MaxRuns` runs or `MaxFiles`
+     * response files.
+     */
+    template<auto const& Spec, size_t MaxRuns = 16, size_t MaxFiles = 4>
+    class Cli {
+        private:
+            using tables = detail::ParseTables<Spec>;
+            static_assert(tables::flag_names_valid, "Flag names must be longer than one character");
+            static_assert(tables::flag_names_unique, "Flag name conflicts with another flag visible to the same command");
+            static_assert(tables::shorthands_unique, "Flag shorthand conflicts with another flag visible to the same command");
+            static_assert(tables::subcommands_unique, "Subcommand name conflicts with a sibling subcommand");
+        public:
+            using Action = int(*)(Cli const&, Args);
+        private:
+            typename tables::values_type values_;
+            std::array<Action, tables::command_count> actions_{};
+            size_t command_ = 0;
+            // response files string values may point into, kept until the next execute
+            pnt_cli::detail::InlineArgStore<MaxRuns, MaxFiles> store_;
+
+            /**
+             * @brief Adapts the parse tables to detail::try_parse_argv, tracking the command reached so far.
+             */
+            struct Dispatcher {
+                Cli& cli;
+                size_t cmd = 0;
+                const detail::FlagEntry* find_flag(std::string_view name) const {
+                    size_t flag = name.length() == 1 ?
+                        tables::find_shorthand(cmd, name[0]) :
+                        tables::find_flag(cmd, name);
+                    return flag != detail::npos ? &tables::flags[flag] : nullptr;
+                }
+                bool is_bool(const detail::FlagEntry* flag) const { return flag->is_bool; }
+                ConversionError set(const detail::FlagEntry* flag, std::string_view value) const {
+                    return tables::setters[flag->index](cli.values_, value);
+                }
+                bool enter(std::string_view name) {
+                    size_t sub = tables::find_subcommand(cmd, name);
+                    if (sub != detail::npos) cmd = sub;
+                    return sub != detail::npos;
+                }
+            };
+        public:
+            constexpr Cli() : values_(tables::defaults()) {}
+
+            /**
+             * @brief Binds the action of the command at the space separated path (`""` for the root).
+             */
+            template<fixed_string Path>
+            constexpr Cli& bind(Action action) {
+                constexpr size_t cmd = tables::find_command(Path.view());
+                static_assert(cmd != detail::npos, "No such command in schema");
+                actions_[cmd] = action;
+                return *this;
+            }
+            /**
+             * @brief Gets the value of a flag visible to the command at the space separated path.
+             *
+             * @tparam Name the name of the flag
+             * @tparam Path the command path, the root by default
+             * @return a reference to the flag value (std::string_view for std::string flags)
+             */
+            template<fixed_string Name, fixed_string Path = "">
+            constexpr const auto& get() const {
+                constexpr size_t cmd = tables::find_command(Path.view());
+                static_assert(cmd != detail::npos, "No such command in schema");
+                constexpr size_t flag = tables::find_flag(cmd, Name.view());
+                static_assert(flag != detail::npos, "No such flag visible to command");
+                return std::get<flag>(values_);
+            }
+            /**
+             * @brief Name of the command reached by the last execute.
+             */
+            constexpr std::string_view command() const { return tables::commands[command_].name; }
+            /**
+             * @brief Resets all flags to their defaults.
+             */
+            constexpr void reset() { values_ = tables::defaults(); }
+
+            /**
+             * @brief Parses argv against the schema and invokes the bound action of the command reached.
+             * Grammar is the same as Command::execute.
+             *
+             * @return the return value of the invoked action
+             */
+            int execute(int argc, char** argv) {
+                return tryExecute(argc, argv).value();
+            }
+            /**
+             * @brief execute without raising parse errors, or the error of a command reached without an action.
+             */
+            Result<int> tryExecute(int argc, char** argv) {
+                Dispatcher dispatcher{*this};
+                store_.clear();
+                Error err = pnt_cli::detail::try_parse_argv(dispatcher, argc, argv, store_);
+                command_ = dispatcher.cmd;
+                if (!err && !actions_[command_])
+                    err.code = ErrorCode::no_action;
+                if (err) {
+                    err.command = path(command_);
+                    return err;
+                }
+                return actions_[command_](*this, Args(store_.runs));
+            }
+        private:
+            /**
+             * @brief The names of the commands from the root to the one at index `cmd`, space separated.
+             */
+            static std::string path(size_t cmd) {
+                std::string_view name = tables::commands[cmd].name;
+                if (tables::commands[cmd].parent == detail::npos) return std::string(name);
+                return path(tables::commands[cmd].parent) + " " + std::string(name);
+            }
+    };
+} // namespace pnt_cli::schema
+
+#endif // SCHEMA_HPP_
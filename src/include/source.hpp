@@ -0,0 +1,242 @@
+/**
+ * @file source.hpp
+ * @author Zografos Orfeas
+ * @brief Configuration sources other than argv, applied to a command tree through its flags.
+ * @version 0.1
+ * @date 2022-04-17
+ */
+
+#ifndef SOURCE_HPP_
+#define SOURCE_HPP_
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <functional>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <utils.hpp>
+#include <flag.hpp>
+#include <command.hpp>
+
+// only declared by <unistd.h> with _GNU_SOURCE (glibc), never on macOS/BSD
+extern char** environ;
+
+//!Note: Config files are a subset of INI/TOML:
+//!Note:     # comment, ; comment
+//!Note:     verbose = true          # flags visible to the command the file is applied to
+//!Note:     [build]                 # flags visible to a subcommand, nested ones as [build.release]
+//!Note:     out = "a.out"           # quotes are stripped, there are no escape sequences
+//!Note: Keys are full flag names, sections are subcommand names or aliases (not prefixes).
+//!Note: Environment variables are named <PREFIX>_<SUBCOMMAND PATH>_<FLAG>, upper case with '-' turned into '_',
+//!Note: e.g. APP_VERBOSE for a flag of the root, APP_BUILD_RELEASE_RATIO for a flag of `build release`.
+//!Note: Flags are bound by the command that defines them, persistent ones are not repeated for subcommands.
+//!Note: Sources are applied in order, giving the precedence default < file < environment < argv with:
+//!Note:     ConfigFile(path).apply(*root);
+//!Note:     EnvSource("APP").apply(*root);
+//!Note:     root->execute(argc, argv);
+
+namespace pnt_cli {
+    /**
+     * @brief A memory mapped config file, tokenized in place on every apply.
+     */
+    class ConfigFile {
+        private:
+            std::string path_;
+            utils::MappedFile file_;
+
+            [[noreturn]] void fail(size_t line, const std::string& msg) const;
+            Command* find_section(Command& root, std::string_view, size_t line) const;
+        public:
+            /**
+             * @brief Maps the file at `path`
+             *
+             * @throws std::runtime_error if the file can't be opened or mapped
+             */
+            explicit ConfigFile(const std::string& path);
+
+            /**
+             * @brief Sets the flags listed in the file, sections being resolved from `root`.
+             *
+             * @throws std::runtime_error on malformed lines, unknown sections or flags and invalid values
+             */
+            void apply(Command& root) const;
+
+            const std::string& path() const;
+    };
+    inline ConfigFile::ConfigFile(const std::string& path) : path_(path), file_(path) {}
+    inline const std::string& ConfigFile::path() const { return path_; }
+
+    namespace detail {
+        inline std::string_view trim(std::string_view sv) {
+            constexpr std::string_view ws = " \t\r";
+            size_t first = sv.find_first_not_of(ws);
+            if (first == std::string_view::npos) return {};
+            return sv.substr(first, sv.find_last_not_of(ws) - first + 1);
+        }
+    } // namespace detail
+
+    inline void ConfigFile::fail(size_t line, const std::string& msg) const {
+        utils::raise(path_ + ":" + std::to_string(line) + ": " + msg);
+    }
+    inline Command* ConfigFile::find_section(Command& root, std::string_view section, size_t line) const {
+        Command* cmd = &root;
+        while (!section.empty()) {
+            size_t dot = section.find('.');
+            std::string_view name = detail::trim(section.substr(0, dot));
+            Command* sub = cmd->find_subcommand(name);
+            if (!sub)
+                fail(line, "Unknown command: " + std::string(name));
+            cmd = sub;
+            section = dot == std::string_view::npos ? std::string_view() : section.substr(dot + 1);
+        }
+        return cmd;
+    }
+    inline void ConfigFile::apply(Command& root) const {
+        std::string_view contents = file_.view();
+        Command* cmd = &root;
+        size_t line_no = 0;
+        while (!contents.empty()) {
+            const void* nl = std::memchr(contents.data(), '\n', contents.size());
+            size_t len = nl ? static_cast<const char*>(nl) - contents.data() : contents.size();
+            std::string_view line = detail::trim(contents.substr(0, len));
+            contents.remove_prefix(nl ? len + 1 : len);
+            line_no++;
+
+            if (line.empty() || line[0] == '#' || line[0] == ';')
+                continue;
+            if (line[0] == '[') {
+                if (line.back() != ']')
+                    fail(line_no, "Unterminated section: " + std::string(line));
+                cmd = find_section(root, detail::trim(line.substr(1, line.length() - 2)), line_no);
+                continue;
+            }
+            size_t eq = line.find('=');
+            if (eq == std::string_view::npos)
+                fail(line_no, "Expected key = value: " + std::string(line));
+            std::string_view key = detail::trim(line.substr(0, eq));
+            std::string_view value = detail::trim(line.substr(eq + 1));
+            if (!value.empty() && (value[0] == '"' || value[0] == '\'')) {
+                size_t close = value.find(value[0], 1);
+                if (close == std::string_view::npos)
+                    fail(line_no, "Unterminated string: " + std::string(value));
+                std::string_view rest = detail::trim(value.substr(close + 1));
+                if (!rest.empty() && rest[0] != '#')
+                    fail(line_no, "Unexpected characters after string: " + std::string(rest));
+                value = value.substr(1, close - 1);
+            } else {
+                value = detail::trim(value.substr(0, value.find('#')));
+            }
+
+            cmd->ensure_flag_tables();
+            FlagRef flag = cmd->visible_flags_.find_name(key);
+            if (!flag)
+                fail(line_no, "Unknown flag: " + std::string(key));
+            if (auto err = flag.trySetCopy(value); err != ConversionError::none)
+                fail(line_no, "Invalid value for flag " + std::string(key) + ": " +
+                    conversionErrorMessage(err) + ": " + std::string(value));
+        }
+    }
+
+    /**
+     * @brief Binds flags to environment variables, resolved in a single scan of the environment.
+     */
+    class EnvSource {
+        private:
+            struct string_hash {
+                using is_transparent = void;
+                size_t operator()(std::string_view sv) const { return std::hash<std::string_view>()(sv); }
+            };
+            using Bindings = std::unordered_map<std::string, FlagRef, string_hash, std::equal_to<>>;
+
+            std::string prefix_;
+
+            void bind_command(const Command&, std::string& key, Bindings&) const;
+        public:
+            /**
+             * @param prefix the prefix of all variable names, without the trailing '_'
+             */
+            explicit EnvSource(std::string prefix);
+
+            /**
+             * @brief The variable name bound to flag `flag` of the command at subcommand path `path`.
+             * 
+             * @param path space separated subcommand names from the root, empty for the root itself
+             */
+            std::string variableName(std::string_view path, std::string_view flag) const;
+
+            /**
+             * @brief Sets the flags of the tree rooted at `root` whose variables are set in `env`
+             * 
+             * @param env NULL terminated array of "NAME=value" strings, the process environment by default
+             * @throws std::runtime_error if two flags map to the same variable or on invalid values
+             */
+            void apply(Command& root, char** env = environ) const;
+    };
+    inline EnvSource::EnvSource(std::string prefix) : prefix_(std::move(prefix)) {}
+
+    namespace detail {
+        // Appends `_NAME` to `key`, `name` upper cased with '-' turned into '_'
+        inline void append_env_component(std::string& key, std::string_view name) {
+            key += '_';
+            for (char c : name)
+                key += c == '-' ? '_' : (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+        }
+    } // namespace detail
+
+    inline std::string EnvSource::variableName(std::string_view path, std::string_view flag) const {
+        std::string key = prefix_;
+        while (!path.empty()) {
+            size_t space = path.find(' ');
+            detail::append_env_component(key, path.substr(0, space));
+            path = space == std::string_view::npos ? std::string_view() : path.substr(space + 1);
+        }
+        detail::append_env_component(key, flag);
+        return key;
+    }
+    inline void EnvSource::bind_command(const Command& cmd, std::string& key, Bindings& bindings) const {
+        size_t length = key.length();
+        cmd.expand();
+        for (const FlagSet* set : {&cmd.persistent_flags_, &cmd.local_flags_}) {
+            for (FlagRef flag : set->index()) {
+                detail::append_env_component(key, flag.name());
+                if (!bindings.emplace(key, flag).second)
+                    utils::raise("Environment variable " + key + " is bound to more than one flag");
+                key.resize(length);
+            }
+        }
+        for (const Command* sub : cmd.subcommands_) {
+            detail::append_env_component(key, sub->name_);
+            bind_command(*sub, key, bindings);
+            key.resize(length);
+        }
+    }
+    inline void EnvSource::apply(Command& root, char** env) const {
+        Bindings bindings;
+        std::string key = prefix_;
+        bind_command(root, key, bindings);
+        if (bindings.empty() || !env)
+            return;
+        for (; *env; env++) {
+            std::string_view var = *env;
+            // most of the environment belongs to other programs, skip it without hashing
+            if (var.length() <= prefix_.length() || !var.starts_with(prefix_) || var[prefix_.length()] != '_')
+                continue;
+            size_t eq = var.find('=');
+            if (eq == std::string_view::npos)
+                continue;
+            auto it = bindings.find(var.substr(0, eq));
+            if (it == bindings.end())
+                continue;
+            std::string_view value = var.substr(eq + 1);
+            if (auto err = it->second.trySetCopy(value); err != ConversionError::none)
+                utils::raise("Invalid value for environment variable " + it->first + ": " +
+                    conversionErrorMessage(err) + ": " + std::string(value));
+        }
+    }
+} // namespace pnt_cli
+
+#endif // SOURCE_HPP_
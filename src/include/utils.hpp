@@ -4,7 +4,22 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <string_view>
 #include <map>
+#include <charconv>
+#include <system_error>
+#include <utility>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 
 namespace pnt_cli::utils {
     // https://codereview.stackexchange.com/questions/48594/unique-type-id-no-rtti 
@@ -31,6 +46,129 @@ namespace pnt_cli::utils {
      */
     template<typename T> type_id_t type_id() { return &type_id<T>; }
 
+    //!Note: Errors are raised through raise, which throws, or with exceptions disabled (-fno-exceptions)
+    //!Note: prints the message and aborts. The try* APIs report errors as values and never raise.
+    /**
+     * @brief Throws `E(msg)`, or prints `msg` and aborts if exceptions are disabled.
+     */
+    template<typename E = std::runtime_error>
+    [[noreturn]] inline void raise(const std::string& msg) {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+        throw E(msg);
+#else
+        std::fputs(msg.c_str(), stderr);
+        std::fputc('\n', stderr);
+        std::abort();
+#endif
+    }
+
+    /**
+     * @brief Read-only private mapping of a whole file, unmapped on destruction.
+     */
+    class MappedFile {
+        private:
+            const char* data_ = nullptr;
+            size_t size_ = 0;
+        public:
+            MappedFile() = default;
+            /**
+             * @brief Maps the file at `path`
+             * 
+             * @throws std::runtime_error if the file can't be opened or mapped
+             */
+            explicit MappedFile(const std::string& path);
+            /**
+             * @brief Maps the file at `path`, replacing the current mapping on success
+             * 
+             * @return 0 on success, the errno value of the failed call otherwise
+             */
+            int open(const std::string& path) noexcept;
+            int open(const char* path) noexcept;
+            MappedFile(MappedFile&& other) noexcept
+                : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+            MappedFile& operator=(MappedFile&& other) noexcept {
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+                return *this;
+            }
+            ~MappedFile();
+
+            std::string_view view() const { return {data_, size_}; }
+
+            MappedFile(MappedFile const&) = delete;
+            MappedFile& operator=(MappedFile const&) = delete;
+    };
+    inline MappedFile::MappedFile(const std::string& path) {
+        if (int err = open(path))
+            raise("Could not open " + path + ": " + std::strerror(err));
+    }
+    inline int MappedFile::open(const std::string& path) noexcept {
+        return open(path.c_str());
+    }
+    inline int MappedFile::open(const char* path) noexcept {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return errno;
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            int err = errno;
+            ::close(fd);
+            return err;
+        }
+        // mmap rejects empty mappings, an empty file is simply an empty view
+        void* data = nullptr;
+        if (st.st_size > 0) {
+            data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                return err;
+            }
+            ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+        data_ = static_cast<const char*>(data);
+        size_ = data ? st.st_size : 0;
+        return 0;
+    }
+    inline MappedFile::~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    /**
+     * @brief Columns of the terminal `fd` is connected to, else $COLUMNS, else 80.
+     */
+    inline int terminal_width(int fd = STDOUT_FILENO) {
+        struct winsize ws;
+        if (::ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+            return ws.ws_col;
+        if (const char* columns = std::getenv("COLUMNS")) {
+            int width = 0;
+            std::string_view str = columns;
+            auto res = std::from_chars(str.data(), str.data() + str.size(), width);
+            if (res.ec == std::errc() && width > 0)
+                return width;
+        }
+        return 80;
+    }
+    /**
+     * @brief Writes all of `data` to `fd`, retrying on partial writes and EINTR.
+     * 
+     * @return false on error
+     */
+    inline bool write_all(int fd, std::string_view data) {
+        while (!data.empty()) {
+            ssize_t written = ::write(fd, data.data(), data.size());
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data.remove_prefix(written);
+        }
+        return true;
+    }
+
     template<typename T>
     concept Printable = requires (std::ostream& os, const T& t) {
         os << t;
@@ -40,8 +178,8 @@ namespace pnt_cli::utils {
         { os << *t };
     };
 
-    template<Printable K, Printable V>
-    inline std::string stringify_map(const std::map<K, V>& m) {
+    template<Printable K, Printable V, typename C>
+    inline std::string stringify_map(const std::map<K, V, C>& m) {
         std::stringstream ss;
         ss << "{";
         for (bool first = true; const auto& [k, v] : m) {
@@ -53,8 +191,8 @@ namespace pnt_cli::utils {
         return ss.str();
     }
 
-    template<Printable K, InderectlyPrintable V>
-    inline std::string stringify_indirect_map(const std::map<K, V>& m) {
+    template<Printable K, InderectlyPrintable V, typename C>
+    inline std::string stringify_indirect_map(const std::map<K, V, C>& m) {
         std::stringstream ss;
         ss << "{";
         for (bool first = true; const auto& [k, v] : m) {
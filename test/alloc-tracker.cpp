@@ -0,0 +1,44 @@
+#include <new>
+#include <cstdlib>
+
+#include <alloc-tracker.hpp>
+
+namespace {
+    // per thread, so that allocations of other threads (e.g. the async logger) don't count
+    thread_local std::size_t active = 0;
+    thread_local std::size_t allocations = 0;
+    thread_local std::size_t allocated_bytes = 0;
+
+    void* allocate(std::size_t size, std::size_t alignment) {
+        if (active) {
+            allocations++;
+            allocated_bytes += size;
+        }
+        if (size == 0) size = 1;
+        void* ptr = alignment > alignof(std::max_align_t)
+            ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+            : std::malloc(size);
+        if (!ptr) throw std::bad_alloc();
+        return ptr;
+    }
+} // namespace
+
+namespace alloc_tracker {
+    AllocationCounter::AllocationCounter() : start_count_(allocations), start_bytes_(allocated_bytes) { active++; }
+    AllocationCounter::~AllocationCounter() { active--; }
+    std::size_t AllocationCounter::count() const { return allocations - start_count_; }
+    std::size_t AllocationCounter::bytes() const { return allocated_bytes - start_bytes_; }
+} // namespace alloc_tracker
+
+void* operator new(std::size_t size) { return allocate(size, 0); }
+void* operator new[](std::size_t size) { return allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t al) { return allocate(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return allocate(size, static_cast<std::size_t>(al)); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
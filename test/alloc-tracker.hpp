@@ -0,0 +1,33 @@
+#ifndef ALLOC_TRACKER_HPP_
+#define ALLOC_TRACKER_HPP_
+
+#include <cstddef>
+
+//!Note: Replaces the global operator new/delete of the test binaries linking alloc-tracker.o,
+//!Note: counting allocations made by the current thread while an AllocationCounter is alive:
+//!Note:     AllocationCounter allocs;
+//!Note:     cmd->getFlag<int>("count");
+//!Note:     EXPECT_EQ(allocs.count(), 0u);
+
+namespace alloc_tracker {
+    /**
+     * @brief Counts the allocations made by the current thread during its lifetime.
+     * Counters nest, each seeing the allocations made during its own lifetime.
+     */
+    class AllocationCounter {
+        private:
+            std::size_t start_count_;
+            std::size_t start_bytes_;
+        public:
+            AllocationCounter();
+            ~AllocationCounter();
+
+            std::size_t count() const;
+            std::size_t bytes() const;
+
+            AllocationCounter(AllocationCounter const&) = delete;
+            AllocationCounter& operator=(AllocationCounter const&) = delete;
+    };
+} // namespace alloc_tracker
+
+#endif // ALLOC_TRACKER_HPP_
@@ -0,0 +1,147 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <gtest/gtest.h>
+#include <command.hpp>
+#include <batch.hpp>
+#include <source.hpp>
+
+using namespace pnt_cli;
+using namespace std;
+
+class BatchTest : public ::testing::Test {
+    protected:
+        shared_ptr<Command> rootCmd;
+        // count and positionals of each invocation
+        std::vector<std::pair<int, std::vector<std::string>>> calls_;
+        std::vector<std::string> outputs_;
+
+        void SetUp() override {
+            rootCmd = makeCommand("tool", "a tool", [] (Command const&, Args) { return 0; });
+            auto count = rootCmd->addPersistentFlag<int>("count", "a count", 0, "c");
+            auto build = rootCmd->addSubcommand("build", "builds", [this, count] (Command const& cmd, Args args) {
+                calls_.emplace_back(*count, std::vector<std::string>());
+                for (auto arg : args) calls_.back().second.emplace_back(arg);
+                outputs_.emplace_back(*cmd.getFlagIf<std::string_view>("out"));
+                return static_cast<int>(calls_.back().second.size());
+            });
+            build->addLocalFlag<std::string_view>("out", "an output", "a.out", "o");
+        }
+        // runs the lines of `input` through a pipe, returning what was written as statuses
+        std::string run(const std::string& input, char delimiter = '\n') {
+            int in[2], status[2];
+            EXPECT_EQ(::pipe(in), 0);
+            EXPECT_EQ(::pipe(status), 0);
+            EXPECT_TRUE(utils::write_all(in[1], input));
+            ::close(in[1]);
+            BatchRunner runner(*rootCmd, {.delimiter = delimiter, .status_fd = status[1], .error_fd = -1});
+            EXPECT_TRUE(runner.run(in[0]));
+            ::close(in[0]);
+            ::close(status[1]);
+            std::string statuses = read_all(status[0]);
+            ::close(status[0]);
+            return statuses;
+        }
+        static std::string read_all(int fd) {
+            std::string out;
+            char buf[256];
+            for (ssize_t got; (got = ::read(fd, buf, sizeof(buf))) > 0; )
+                out.append(buf, got);
+            return out;
+        }
+        static std::string socket_path() {
+            return (std::filesystem::temp_directory_path() / ("pnt-cli-test-" + std::to_string(::getpid()) + ".sock")).string();
+        }
+        // connects to the socket at `path`, waiting for it to be listened on
+        static int connect_to(const std::string& path) {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strcpy(addr.sun_path, path.c_str());
+            while (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0)
+                std::this_thread::yield();
+            return fd;
+        }
+        using Calls = std::vector<std::pair<int, std::vector<std::string>>>;
+};
+
+TEST_F(BatchTest, DispatchesEachLineWithFlagsReset) {
+    // the first line's action returns 2, the fourth fails to parse with unknown_flag (2)
+    EXPECT_EQ(run("build --count 3 a 'b c' -o x\n\n  build  d\nbuild --bogus\n-c 5 build\n"), "2\n1\ne2\n0\n");
+    EXPECT_EQ(calls_, (Calls{{3, {"a", "b c"}}, {0, {"d"}}, {5, {}}}));
+    EXPECT_EQ(outputs_, (std::vector<std::string>{"x", "a.out", "a.out"}));
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 0);
+}
+
+TEST_F(BatchTest, LinesStartFromTheValuesOfConfigSources) {
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-test-" + std::to_string(::getpid()) + ".ini")).string();
+    std::ofstream(path) << "count = 2\n[build]\nout = file\n";
+    // std::string_view flags view the file's mapping
+    ConfigFile file(path);
+    file.apply(*rootCmd);
+    std::filesystem::remove(path);
+    std::string var = "APP_COUNT=3";
+    char* env[] = {var.data(), nullptr};
+    EnvSource("APP").apply(*rootCmd, env);
+    // default < file < env < the args of each line
+    EXPECT_EQ(run("build -o x a\nbuild b\nbuild -c 5\nbuild\n"), "1\n1\n0\n0\n");
+    EXPECT_EQ(calls_, (Calls{{3, {"a"}}, {3, {"b"}}, {5, {}}, {3, {}}}));
+    EXPECT_EQ(outputs_, (std::vector<std::string>{"x", "file", "file", "file"}));
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 3);
+}
+
+TEST_F(BatchTest, SplitsOnNulAndDispatchesTheLastLine) {
+    EXPECT_EQ(run(std::string("build a\nb\0build -c1 c\0build \"d", 30), '\0'), std::string("2\0" "1\0" "e6\0", 7));
+    EXPECT_EQ(calls_, (Calls{{0, {"a", "b"}}, {1, {"c"}}}));
+}
+
+TEST_F(BatchTest, ServesLinesOfEachConnection) {
+    std::string path = socket_path();
+    BatchRunner runner(*rootCmd, {.error_fd = -1});
+    Result<void> served;
+    std::thread server([&] { served = runner.serve(path, 2); });
+    for (std::string lines : {"build a\nbuild -c2 b c\n", "build\n"}) {
+        int fd = connect_to(path);
+        EXPECT_TRUE(utils::write_all(fd, lines));
+        ::shutdown(fd, SHUT_WR);
+        EXPECT_EQ(read_all(fd), lines == "build\n" ? "0\n" : "1\n2\n");
+        ::close(fd);
+    }
+    server.join();
+    EXPECT_TRUE(served);
+    EXPECT_FALSE(std::filesystem::exists(path));
+    EXPECT_EQ(calls_, (Calls{{0, {"a"}}, {2, {"b", "c"}}, {0, {}}}));
+}
+
+TEST_F(BatchTest, OutlivesClientsClosingBeforeTheirReply) {
+    std::atomic<bool> closed = false;
+    rootCmd->addSubcommand("wait", "waits for the client to close", [&closed] (Command const&, Args) {
+        while (!closed) std::this_thread::yield();
+        return 0;
+    });
+    std::string path = socket_path();
+    BatchRunner runner(*rootCmd, {.error_fd = -1});
+    Result<void> served;
+    std::thread server([&] { served = runner.serve(path, 2); });
+    int fd = connect_to(path);
+    EXPECT_TRUE(utils::write_all(fd, "wait\nbuild a\n"));
+    ::close(fd);
+    closed = true;
+    // the server replies to the closed connection, then serves the next one
+    fd = connect_to(path);
+    EXPECT_TRUE(utils::write_all(fd, "build b c\n"));
+    ::shutdown(fd, SHUT_WR);
+    EXPECT_EQ(read_all(fd), "2\n");
+    ::close(fd);
+    server.join();
+    EXPECT_TRUE(served);
+    EXPECT_EQ(calls_.back(), (std::pair<int, std::vector<std::string>>{0, {"b", "c"}}));
+}
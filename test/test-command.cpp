@@ -1,16 +1,44 @@
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+
+#include <fcntl.h>
 
 // #include <test.hpp>
 #include <command.hpp>
+#include <alloc-tracker.hpp>
 #include <gtest/gtest.h>
 
 using namespace pnt_cli;
 using namespace std;
 
-auto someDefaultAction = [] (Command const& cmd, std::vector<std::string> args) {
+auto someDefaultAction = [] (Command const& cmd, Args args) {
     return 0;
 };
 
+// custom flag type counting its conversions
+struct Seconds {
+    long count;
+    static inline int conversions = 0;
+};
+template<>
+ConversionError pnt_cli::tryFromString<Seconds>(std::string_view str, Seconds& out) {
+    Seconds::conversions++;
+    if (str.empty() || str.back() != 's') return ConversionError::invalid_argument;
+    return tryFromString<long>(str.substr(0, str.size() - 1), out.count);
+}
+template<>
+Seconds pnt_cli::fromString<Seconds>(const std::string& str) {
+    Seconds val{};
+    if (auto err = tryFromString<Seconds>(str, val); err != ConversionError::none)
+        utils::raise<std::invalid_argument>(conversionErrorMessage(err));
+    return val;
+}
+template<>
+std::string pnt_cli::toString<Seconds>(const Seconds& val) {
+    return std::to_string(val.count) + "s";
+}
+
 class CommandTest : public ::testing::Test {
     protected:
         static const std::string localFlagName;
@@ -25,6 +53,12 @@ class CommandTest : public ::testing::Test {
         shared_ptr<Command> rootCmd;
         shared_ptr<Command> subCmd;
 
+        // argv storage for execute tests, argv_ points into args_
+        std::vector<std::string> args_;
+        std::vector<char*> argv_;
+        std::vector<std::string> positionals_;
+        std::string invoked_;
+
         void SetUp() override {
             rootCmd = makeCommand("some_command", "some description", someDefaultAction);
         }
@@ -41,6 +75,21 @@ class CommandTest : public ::testing::Test {
             subCmd = makeCommand("sub_command", "sub command description", someDefaultAction);
             rootCmd->addSubcommand(subCmd);
         }
+        Action recordingAction(const std::string& name) {
+            return [this, name] (Command const& cmd, Args args) {
+                invoked_ = name;
+                positionals_.clear();
+                for (auto arg : args) positionals_.emplace_back(arg);
+                return 0;
+            };
+        }
+        int execute(std::vector<std::string> args) {
+            args_ = std::move(args);
+            args_.insert(args_.begin(), "some_command");
+            argv_.clear();
+            for (auto& arg : args_) argv_.push_back(arg.data());
+            return rootCmd->execute(argv_.size(), argv_.data());
+        }
 };
 const std::string CommandTest::localFlagName = "local_flag";
 const std::string CommandTest::localFlagDescription = "local flag description";
@@ -81,4 +130,348 @@ TEST_F(CommandTest, PersistentFlagsWork) {
     EXPECT_TRUE(subCmd->getFlag<bool>(persistentFlagName));
     EXPECT_TRUE(subCmd->getFlag<bool>(persistentFlagShorthand));
     EXPECT_THROW(addPersistentFlagToSub(), std::runtime_error);
-}
\ No newline at end of file
+}
+TEST_F(CommandTest, ExecuteParsesFlags) {
+    rootCmd = makeCommand("some_command", "some description", recordingAction("root"));
+    rootCmd->addPersistentFlag<int>("count", "a count", 0, "c");
+    addPersistentFlagToRoot();
+    EXPECT_EQ(execute({"--count=3"}), 0);
+    EXPECT_EQ(*rootCmd->getFlag<int>("count"), 3);
+    execute({"--count", "4"});
+    EXPECT_EQ(*rootCmd->getFlag<int>("count"), 4);
+    execute({"-c5"});
+    EXPECT_EQ(*rootCmd->getFlag<int>("count"), 5);
+    execute({"-c", "6", "-g"});
+    EXPECT_EQ(*rootCmd->getFlag<int>("count"), 6);
+    EXPECT_TRUE(*rootCmd->getFlag<bool>(persistentFlagName));
+    execute({"--global_flag=false"});
+    EXPECT_FALSE(*rootCmd->getFlag<bool>(persistentFlagName));
+    EXPECT_EQ(invoked_, "root");
+    EXPECT_TRUE(positionals_.empty());
+    EXPECT_THROW(execute({"--unknown"}), std::runtime_error);
+    EXPECT_THROW(execute({"--count"}), std::runtime_error);
+    EXPECT_THROW(execute({"--count=3x"}), std::runtime_error);
+    EXPECT_EQ(*rootCmd->getFlag<int>("count"), 6);
+}
+
+TEST_F(CommandTest, ExecuteDispatchesSubcommands) {
+    rootCmd = makeCommand("some_command", "some description", recordingAction("root"));
+    addPersistentFlagToRoot();
+    subCmd = rootCmd->addSubcommand("sub_command", "sub command description", recordingAction("sub"));
+    subCmd->addLocalFlag<std::string>("name", "a name", "", "n");
+    execute({"-g", "sub_command", "a", "--name", "x", "sub_command", "--", "-b", "--name"});
+    EXPECT_EQ(invoked_, "sub");
+    EXPECT_EQ(positionals_, (std::vector<std::string>{"a", "sub_command", "-b", "--name"}));
+    EXPECT_EQ(*subCmd->getFlag<std::string>("name"), "x");
+    EXPECT_TRUE(*subCmd->getFlag<bool>(persistentFlagShorthand));
+    execute({"a", "sub_command", "-"});
+    EXPECT_EQ(invoked_, "root");
+    EXPECT_EQ(positionals_, (std::vector<std::string>{"a", "sub_command", "-"}));
+    // local flags of a subcommand are not visible before dispatching to it
+    EXPECT_THROW(execute({"--name", "x", "sub_command"}), std::runtime_error);
+}
+
+TEST_F(CommandTest, TreeIsReleasedWithItsRoot) {
+    std::weak_ptr<Command> weakRoot = rootCmd;
+    auto sub = rootCmd->addSubcommand("sub_command", "sub command description", someDefaultAction);
+    auto subSub = sub->addSubcommand("sub_sub_command", "sub sub command description", someDefaultAction);
+    EXPECT_THROW(sub->addSubcommand("sub_sub_command", "duplicate", someDefaultAction), std::runtime_error);
+    rootCmd.reset();
+    sub.reset();
+    EXPECT_FALSE(weakRoot.expired());
+    subSub.reset();
+    EXPECT_TRUE(weakRoot.expired());
+}
+
+TEST_F(CommandTest, AdoptedTreesAreDetachedWhenParentIsReleased) {
+    addPersistentFlagToRoot();
+    addSubcommandToRoot();
+    EXPECT_THROW(rootCmd->addSubcommand(subCmd), std::runtime_error);
+    EXPECT_THROW(subCmd->addSubcommand(rootCmd), std::runtime_error);
+    rootCmd.reset();
+    EXPECT_FALSE(subCmd->hasParent());
+    EXPECT_FALSE(subCmd->getFlag<bool>(persistentFlagName));
+}
+
+TEST_F(CommandTest, FlagTablesFollowTreeChanges) {
+    auto sub = rootCmd->addSubcommand("sub_command", "sub command description", someDefaultAction);
+    auto subSub = sub->addSubcommand("sub_sub_command", "sub sub command description", someDefaultAction);
+    sub->addPersistentFlag<int>("depth", "a depth", 1, "d");
+    rootCmd->finalize();
+    EXPECT_EQ(subSub->getFlag<int>("d"), 1);
+    EXPECT_FALSE(rootCmd->getFlag<int>("depth"));
+    // tables built above are rebuilt once the tree changes
+    addPersistentFlagToRoot();
+    EXPECT_TRUE(subSub->getFlag<bool>(persistentFlagShorthand));
+    subSub->addLocalFlag<int>("leaf", "a leaf flag", 2);
+    EXPECT_EQ(subSub->getFlag<int>("leaf"), 2);
+    EXPECT_FALSE(sub->getFlag<int>("leaf"));
+    EXPECT_THROW(subSub->addLocalFlag<int>(persistentFlagName, "a conflicting flag", 0), std::runtime_error);
+    EXPECT_THROW(subSub->addLocalFlag<int>("other_depth", "a conflicting shorthand", 0, "d"), std::runtime_error);
+    // persistent flags are shared, not copied
+    EXPECT_TRUE(subSub->setFlag<int>("depth", "5"));
+    EXPECT_EQ(sub->getFlag<int>("depth"), 5);
+}
+
+TEST_F(CommandTest, ExecuteResolvesAliasesAndPrefixes) {
+    rootCmd = makeCommand("some_command", "some description", recordingAction("root"));
+    auto status = rootCmd->addSubcommand("status", "status description", recordingAction("status"));
+    rootCmd->addSubcommand("stash", "stash description", recordingAction("stash"));
+    status->addAlias("st");
+    EXPECT_THROW(status->addAlias("stash"), std::runtime_error);
+    EXPECT_THROW(rootCmd->addSubcommand("st", "taken by an alias", someDefaultAction), std::runtime_error);
+    execute({"st"});
+    EXPECT_EQ(invoked_, "status");
+    execute({"stat"});
+    EXPECT_EQ(invoked_, "root");
+    rootCmd->setPrefixMatching();
+    execute({"stat", "x"});
+    EXPECT_EQ(invoked_, "status");
+    EXPECT_EQ(positionals_, (std::vector<std::string>{"x"}));
+    execute({"sta"});
+    EXPECT_EQ(invoked_, "root");
+    execute({"stas"});
+    EXPECT_EQ(invoked_, "stash");
+    // prefixes resolve against commands added after the index was used
+    rootCmd->addSubcommand("stage", "stage description", recordingAction("stage"));
+    execute({"stag"});
+    EXPECT_EQ(invoked_, "stage");
+    execute({"stas"});
+    EXPECT_EQ(invoked_, "stash");
+}
+
+TEST_F(CommandTest, ExecuteCollectsRepeatedListFlags) {
+    rootCmd->addLocalFlag<std::vector<std::string>>("include", "include paths", {"default"}, "I");
+    execute({"--include", "a,b", "-Ic", "--include=d"});
+    EXPECT_EQ(rootCmd->getFlag<std::vector<std::string>>("include"), (std::vector<std::string>{"a", "b", "c", "d"}));
+}
+
+TEST_F(CommandTest, ExecuteExpandsResponseFiles) {
+    rootCmd = makeCommand("some_command", "some description", recordingAction("root"));
+    rootCmd->addPersistentFlag<int>("count", "a count", 0, "c");
+    rootCmd->addLocalFlag<std::string>("out", "an output", "", "o");
+    auto build = rootCmd->addSubcommand("build", "build description", recordingAction("build"));
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-test-" + std::to_string(::getpid()) + ".rsp")).string();
+    std::ofstream(path) << "build\n  a.txt 'b c.txt'\n--count 3 \"d.txt\"\n-o\n";
+    execute({"x", "@" + path, "out", "y", "--", "@" + path});
+    EXPECT_EQ(invoked_, "root");
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 3);
+    EXPECT_EQ(rootCmd->getFlag<std::string>("out"), "out");
+    EXPECT_EQ(positionals_, (std::vector<std::string>{"x", "build", "a.txt", "b c.txt", "d.txt", "y", "@" + path}));
+    // subcommands and flag values may come from response files too
+    std::ofstream(path) << "build -c4 @nested";
+    execute({"@" + path, "z"});
+    EXPECT_EQ(invoked_, "build");
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 4);
+    EXPECT_EQ(positionals_, (std::vector<std::string>{"@nested", "z"}));
+    std::ofstream(path) << "'unterminated";
+    EXPECT_THROW(execute({"@" + path}), std::runtime_error);
+    std::filesystem::remove(path);
+    EXPECT_THROW(execute({"@" + path}), std::runtime_error);
+}
+
+TEST_F(CommandTest, HelpListsCommandsAndFlags) {
+    rootCmd->addPersistentFlag<int>("count", "a count", 3, "c");
+    addLocalFlagToRoot();
+    addSubcommandToRoot();
+    subCmd->addAlias("sc");
+    subCmd->addLocalFlag<std::string>("name", "a name", "", "n");
+    const std::string& help = rootCmd->help(80);
+    EXPECT_NE(help.find("some description\n"), std::string::npos);
+    EXPECT_NE(help.find("  some_command [command]\n"), std::string::npos);
+    EXPECT_NE(help.find("  sub_command   sub command description\n"), std::string::npos);
+    EXPECT_NE(help.find("-c, --count int    a count (default 3)\n"), std::string::npos);
+    EXPECT_NE(help.find("    --local_flag   local flag description\n"), std::string::npos);
+    EXPECT_NE(help.find("-h, --help"), std::string::npos);
+    // rendered once per width, until the tree changes
+    EXPECT_EQ(&rootCmd->help(80), &help);
+    EXPECT_EQ(rootCmd->help(80), help);
+    rootCmd->addLocalFlag<bool>("quiet", "no output", false);
+    EXPECT_NE(rootCmd->help(80).find("--quiet"), std::string::npos);
+
+    const std::string& subHelp = subCmd->help(80);
+    EXPECT_NE(subHelp.find("Aliases:\n  sub_command, sc\n"), std::string::npos);
+    EXPECT_NE(subHelp.find("Global Flags:\n  -c, --count int"), std::string::npos);
+    EXPECT_EQ(subHelp.find("--local_flag"), std::string::npos);
+}
+
+TEST_F(CommandTest, HelpWrapsToWidth) {
+    std::string description;
+    for (int i = 0; i < 40; i++) description += "word ";
+    rootCmd->addLocalFlag<int>("count", description, 0, "c");
+    std::string_view help = rootCmd->help(40);
+    size_t lines = 0;
+    while (!help.empty()) {
+        size_t nl = help.find('\n');
+        EXPECT_LE(nl, 40u) << help.substr(0, nl);
+        help.remove_prefix(nl + 1);
+        lines++;
+    }
+    EXPECT_GT(lines, 10u);
+    EXPECT_NE(rootCmd->help(120).size(), 0u);
+}
+
+TEST_F(CommandTest, ExecuteHelpSkipsAction) {
+    rootCmd = makeCommand("some_command", "some description", recordingAction("root"));
+    subCmd = rootCmd->addSubcommand("sub_command", "sub command description", recordingAction("sub"));
+    subCmd->addLocalFlag<bool>("help", "user defined help", false);
+    int out = ::dup(STDOUT_FILENO);
+    ::close(STDOUT_FILENO);
+    ::open("/dev/null", O_WRONLY);
+    EXPECT_EQ(execute({"--help"}), 0);
+    EXPECT_EQ(execute({"-h"}), 0);
+    ::dup2(out, STDOUT_FILENO);
+    ::close(out);
+    EXPECT_EQ(invoked_, "");
+    // a user defined help flag is set like any other
+    execute({"sub_command", "--help"});
+    EXPECT_EQ(invoked_, "sub");
+    EXPECT_TRUE(subCmd->getFlag<bool>("help"));
+}
+
+TEST_F(CommandTest, LazySubcommandsAreBuiltOnFirstUse) {
+    int built = 0;
+    auto lazy = rootCmd->addLazySubcommand("lazy", "lazy description", [&] (Command& cmd) {
+        built++;
+        cmd.addLocalFlag<int>("count", "a count", 0, "c");
+        cmd.addSubcommand("leaf", "leaf description", recordingAction("leaf"));
+        return recordingAction("lazy");
+    });
+    rootCmd->addLazySubcommand("unused", "never built", [] (Command&) -> Action {
+        ADD_FAILURE() << "unused subcommand built";
+        return nullptr;
+    });
+    EXPECT_THROW(rootCmd->addLazySubcommand("lazy", "", nullptr), std::runtime_error);
+    // listed by the parent's help without being built
+    EXPECT_NE(rootCmd->help(80).find("lazy description"), std::string::npos);
+    EXPECT_EQ(built, 0);
+    execute({"lazy", "-c", "3", "x"});
+    EXPECT_EQ(built, 1);
+    EXPECT_EQ(invoked_, "lazy");
+    EXPECT_EQ(lazy->getFlag<int>("count"), 3);
+    execute({"lazy", "leaf"});
+    EXPECT_EQ(built, 1);
+    EXPECT_EQ(invoked_, "leaf");
+
+    int help_built = 0;
+    auto other = rootCmd->addLazySubcommand("other", "", [&] (Command& cmd) {
+        help_built++;
+        cmd.addLocalFlag<bool>("other_flag", "", false);
+        return Action{};
+    });
+    EXPECT_NE(other->help(80).find("--other_flag"), std::string::npos);
+    EXPECT_EQ(help_built, 1);
+}
+
+TEST_F(CommandTest, FlagLookupsDontAllocate) {
+    rootCmd->addPersistentFlag<int>("count", "a count", 3, "c");
+    auto leaf = rootCmd;
+    for (int i = 0; i < 8; i++)
+        leaf = leaf->addSubcommand("sub_command", "sub command description", someDefaultAction);
+    leaf->addLocalFlag<bool>("quiet", "no output", false, "q");
+    rootCmd->finalize();
+    alloc_tracker::AllocationCounter allocs;
+    EXPECT_EQ(leaf->getFlag<int>("count"), 3);
+    EXPECT_EQ(leaf->getFlag<int>("c"), 3);
+    EXPECT_EQ(leaf->getFlag<bool>("quiet"), false);
+    EXPECT_EQ(leaf->getFlag<int>("missing"), std::nullopt);
+    EXPECT_EQ(allocs.count(), 0u);
+}
+
+TEST_F(CommandTest, ParseAllocationsDontGrowWithArgc) {
+    rootCmd->addPersistentFlag<int>("count", "a count", 0, "c");
+    rootCmd->addLocalFlag<bool>("verbose", "verbose output", false, "v");
+    auto sub = rootCmd->addSubcommand("sub_command", "sub command description", someDefaultAction);
+    sub->addLocalFlag<std::string>("output", "an output", "", "o");
+    rootCmd->finalize();
+    auto parse_allocations = [this, &sub] (size_t repeats) {
+        std::vector<std::string> args{"some_command", "sub_command"};
+        for (size_t i = 0; i < repeats; i++)
+            args.insert(args.end(), {"--count=" + std::to_string(i), "-c", "7", "file", "-o", "out"});
+        std::vector<char*> argv;
+        for (auto& arg : args) argv.push_back(arg.data());
+        alloc_tracker::AllocationCounter allocs;
+        EXPECT_EQ(&rootCmd->parse(argv.size(), argv.data()), sub.get());
+        return allocs.count();
+    };
+    size_t few = parse_allocations(1);
+    // the positional runs, whose storage later parses reuse
+    EXPECT_LE(few, 1u);
+    EXPECT_LE(parse_allocations(1000), few);
+}
+
+TEST_F(CommandTest, StringViewFlagsReferenceArgvStorage) {
+    auto out = rootCmd->addLocalFlag<std::string_view>("out", "an output", "", "o");
+    rootCmd->addLocalFlag<std::string>("name", "a name", "", "n");
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-view-" + std::to_string(::getpid()) + ".rsp")).string();
+    std::string payload(4096, 'x');
+    std::ofstream(path) << "--out " << payload;
+    rootCmd->finalize();
+    std::vector<std::string> args{"some_command", "-o", payload, "--name", payload};
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(arg.data());
+    alloc_tracker::AllocationCounter allocs;
+    rootCmd->parse(argv.size(), argv.data());
+    EXPECT_EQ(out.get().data(), args[2].data());
+    EXPECT_EQ(rootCmd->getFlagIf<std::string>("name")->size(), payload.size());
+    size_t parse_allocations = allocs.count();
+    // the std::string flag copies its value
+    EXPECT_GE(parse_allocations, 1u);
+    EXPECT_EQ(rootCmd->getFlagIf<std::string_view>("out")->data(), args[2].data());
+    EXPECT_EQ(allocs.count(), parse_allocations);
+    // response file tokens stay valid after parse returns
+    rootCmd->reset();
+    std::string arg0 = "some_command", rsp = "@" + path;
+    std::vector<char*> rsp_argv{arg0.data(), rsp.data()};
+    rootCmd->parse(rsp_argv.size(), rsp_argv.data());
+    std::filesystem::remove(path);
+    EXPECT_EQ(*out, payload);
+}
+
+TEST_F(CommandTest, CustomFlagsConvertOnFirstRead) {
+    auto timeout = rootCmd->addPersistentFlag<Seconds>("timeout", "a timeout", Seconds{1}, "t");
+    addSubcommandToRoot();
+    auto interval = subCmd->addLocalFlag<Seconds>("interval", "an interval", Seconds{2});
+    Seconds::conversions = 0;
+    execute({"--timeout", "5s", "-t", "7s", "sub_command", "--interval", "oops"});
+    EXPECT_EQ(Seconds::conversions, 0);
+    EXPECT_EQ(timeout->count, 7);
+    EXPECT_EQ(rootCmd->getFlag<Seconds>("timeout")->count, 7);
+    EXPECT_EQ(Seconds::conversions, 1);
+    EXPECT_THROW(interval.get(), std::invalid_argument);
+    auto res = rootCmd->tryValidate();
+    ASSERT_FALSE(res);
+    EXPECT_EQ(res.error().code, ErrorCode::invalid_value);
+    EXPECT_EQ(res.error().token, "--interval");
+    EXPECT_EQ(res.error().detail, "oops");
+    EXPECT_EQ(res.error().command, "some_command sub_command");
+    EXPECT_THROW(rootCmd->validate(), std::runtime_error);
+    // set converts immediately
+    EXPECT_THROW(subCmd->setFlag<Seconds>("interval", "oops"), std::invalid_argument);
+    EXPECT_TRUE(subCmd->setFlag<Seconds>("interval", "3s"));
+    EXPECT_TRUE(rootCmd->tryValidate());
+    EXPECT_EQ(interval->count, 3);
+    execute({"sub_command", "--interval=4s"});
+    rootCmd->reset();
+    EXPECT_TRUE(rootCmd->tryValidate());
+    EXPECT_EQ(interval->count, 2);
+}
+
+TEST_F(CommandTest, FlagHandlesReadParsedValues) {
+    auto count = rootCmd->addPersistentFlag<int>("count", "a count", 3, "c");
+    addSubcommandToRoot();
+    auto output = subCmd->addLocalFlag<std::string>("output", "an output", std::string(64, 'x'), "o");
+    EXPECT_TRUE(count);
+    EXPECT_FALSE(FlagHandle<int>());
+    EXPECT_EQ(count.get(), 3);
+    execute({"sub_command", "-c", "5", "--output", std::string(100, 'y')});
+    alloc_tracker::AllocationCounter allocs;
+    EXPECT_EQ(count.get(), 5);
+    EXPECT_EQ(*count, 5);
+    EXPECT_EQ(output.view().size(), 100u);
+    EXPECT_EQ(output->front(), 'y');
+    EXPECT_EQ(&output.view(), subCmd->getFlagIf<std::string>("output"));
+    EXPECT_EQ(allocs.count(), 0u);
+    rootCmd->reset();
+    EXPECT_EQ(output.view(), std::string(64, 'x'));
+}
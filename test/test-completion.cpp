@@ -0,0 +1,105 @@
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <command.hpp>
+#include <completion.hpp>
+
+using namespace pnt_cli;
+using namespace std;
+
+class CompletionTest : public ::testing::Test {
+    protected:
+        shared_ptr<Command> rootCmd;
+        shared_ptr<Command> buildCmd;
+
+        void SetUp() override {
+            auto noop = [] (Command const&, Args) { return 0; };
+            rootCmd = makeCommand("app", "an app", noop);
+            rootCmd->addPersistentFlag<bool>("verbose", "verbose output", false, "v");
+            buildCmd = rootCmd->addSubcommand("build", "builds", noop);
+            buildCmd->addAlias("b");
+            buildCmd->addLocalFlag<std::string>("output", "an output", "", "o");
+            buildCmd->addSubcommand("release", "release build", noop);
+            rootCmd->addSubcommand("bench", "benchmarks", noop);
+            rootCmd->addSubcommand("test", "tests", noop);
+        }
+        static std::vector<std::string> complete(const CompletionIndex& index, std::vector<const char*> words) {
+            std::string out = index.complete(words);
+            std::vector<std::string> lines;
+            for (size_t start = 0, nl; (nl = out.find('\n', start)) != std::string::npos; start = nl + 1)
+                lines.push_back(out.substr(start, nl - start));
+            return lines;
+        }
+        using Lines = std::vector<std::string>;
+};
+
+TEST_F(CompletionTest, CompletesSubcommandsAndFlags) {
+    CompletionIndex index = rootCmd->completionIndex();
+    EXPECT_EQ(complete(index, {""}), (Lines{"bench", "build", "test"}));
+    EXPECT_EQ(complete(index, {"b"}), (Lines{"b", "bench", "build"}));
+    EXPECT_EQ(complete(index, {"build", ""}), (Lines{"release"}));
+    EXPECT_EQ(complete(index, {"-v", "b", "r"}), (Lines{"release"}));
+    EXPECT_EQ(complete(index, {"--"}), (Lines{"--help", "--verbose"}));
+    EXPECT_EQ(complete(index, {"build", "--o"}), (Lines{"--output"}));
+    EXPECT_EQ(complete(index, {"build", "-"}), (Lines{"-h", "-o", "-v", "--help", "--output", "--verbose"}));
+    EXPECT_EQ(complete(index, {"build", "-o"}), (Lines{"-o"}));
+    // the value of a flag, and positional args, are left to the shell
+    EXPECT_TRUE(complete(index, {"build", "--output", ""}).empty());
+    EXPECT_EQ(complete(index, {"build", "-o", "x", "re"}), (Lines{"release"}));
+    EXPECT_TRUE(complete(index, {"file", ""}).empty());
+    EXPECT_TRUE(complete(index, {"--", "b"}).empty());
+    EXPECT_EQ(complete(index, {"--", "-"}), Lines{});
+}
+
+TEST_F(CompletionTest, FollowsPrefixMatching) {
+    EXPECT_TRUE(complete(rootCmd->completionIndex(), {"bu", ""}).empty());
+    rootCmd->setPrefixMatching();
+    EXPECT_EQ(complete(rootCmd->completionIndex(), {"bu", ""}), (Lines{"release"}));
+    // ambiguous
+    EXPECT_TRUE(complete(rootCmd->completionIndex(), {"be", "bu", ""}).empty());
+}
+
+TEST_F(CompletionTest, SavedIndexIsMappedBack) {
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-test-" + std::to_string(::getpid()) + ".cmp")).string();
+    rootCmd->setCompletionCache(path, "1.0");
+    CompletionIndex built = rootCmd->completionIndex();
+    ASSERT_TRUE(built.save(path));
+    CompletionIndex mapped;
+    EXPECT_FALSE(mapped.open(path, CompletionIndex::stampOf("2.0")));
+    ASSERT_TRUE(mapped.open(path, CompletionIndex::stampOf("1.0")));
+    EXPECT_EQ(mapped.size(), built.size());
+    EXPECT_EQ(complete(mapped, {"build", "-"}), complete(built, {"build", "-"}));
+    EXPECT_EQ(complete(mapped, {"b"}), (Lines{"b", "bench", "build"}));
+
+    std::vector<std::string> args{"app", "__complete", "b"};
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(arg.data());
+    EXPECT_EQ(completeFromCache(path, "2.0", argv.size(), argv.data()), std::nullopt);
+    std::vector<char*> not_completion{argv[0], argv[2]};
+    EXPECT_EQ(completeFromCache(path, "1.0", not_completion.size(), not_completion.data()), std::nullopt);
+
+    // truncated files and files of another format are rejected, keeping the current mapping
+    std::string copy = path + ".copy";
+    std::filesystem::copy_file(path, copy);
+    std::filesystem::resize_file(copy, built.size() - 1);
+    EXPECT_FALSE(mapped.open(copy, CompletionIndex::stampOf("1.0")));
+    EXPECT_FALSE(mapped.open("Makefile"));
+    std::filesystem::remove(copy);
+    EXPECT_EQ(complete(mapped, {"t"}), (Lines{"test"}));
+
+    // completion requests handled by execute save the index
+    std::filesystem::remove(path);
+    int out = ::dup(STDOUT_FILENO);
+    ::close(STDOUT_FILENO);
+    ::open("/dev/null", O_WRONLY);
+    EXPECT_EQ(rootCmd->execute(argv.size(), argv.data()), 0);
+    EXPECT_EQ(completeFromCache(path, "1.0", argv.size(), argv.data()), 0);
+    ::dup2(out, STDOUT_FILENO);
+    ::close(out);
+    std::filesystem::remove(path);
+}
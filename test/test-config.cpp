@@ -0,0 +1,80 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <config.hpp>
+
+using namespace pnt_cli;
+using namespace std;
+
+class ConfigTest : public ::testing::Test {
+    protected:
+        shared_ptr<Command> rootCmd;
+        shared_ptr<Command> subCmd;
+        // the loader parses a copy of these on every reload
+        std::vector<std::string> args_;
+
+        void SetUp() override {
+            rootCmd = makeCommand("some_command", "some description", [] (Command const&, Args) { return 0; });
+            rootCmd->addPersistentFlag<int>("low", "lower bound", 0);
+            subCmd = rootCmd->addSubcommand("sub_command", "sub command description", [] (Command const&, Args) { return 0; });
+            subCmd->addLocalFlag<int>("high", "upper bound", 0);
+        }
+        Config::Loader loader() {
+            return [this] (Command& root) {
+                std::vector<std::string> args = args_;
+                std::vector<char*> argv;
+                for (auto& arg : args) argv.push_back(arg.data());
+                root.parse(argv.size(), argv.data());
+            };
+        }
+        void setArgs(int low, int high) {
+            args_ = {"some_command", "sub_command", "--low", std::to_string(low), "--high", std::to_string(high)};
+        }
+};
+
+TEST_F(ConfigTest, ReloadPublishesNewSnapshot) {
+    setArgs(1, 2);
+    Config config(rootCmd, loader());
+    {
+        auto snapshot = config.read();
+        EXPECT_EQ(snapshot->getFlag<int>(*subCmd, "low"), 1);
+        EXPECT_EQ(snapshot->getFlag<int>(*subCmd, "high"), 2);
+        EXPECT_EQ(snapshot->getFlag<int>(*rootCmd, "high"), std::nullopt);
+        EXPECT_EQ(snapshot->getFlag<bool>(*subCmd, "low"), std::nullopt);
+    }
+    EXPECT_FALSE(config.reloadIfRequested());
+    // flags not given on reload fall back to their defaults
+    args_ = {"some_command", "--low", "5"};
+    config.requestReload();
+    EXPECT_TRUE(config.reloadIfRequested());
+    auto snapshot = config.read();
+    EXPECT_EQ(snapshot->getFlag<int>(*subCmd, "low"), 5);
+    EXPECT_EQ(snapshot->getFlag<int>(*subCmd, "high"), 0);
+}
+
+TEST_F(ConfigTest, ReadersSeeConsistentSnapshots) {
+    setArgs(0, 0);
+    Config config(rootCmd, loader());
+    std::atomic<bool> done{false};
+    std::atomic<int> inconsistent{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++)
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                auto snapshot = config.read();
+                if (snapshot->getFlag<int>(*subCmd, "low") != snapshot->getFlag<int>(*subCmd, "high"))
+                    inconsistent++;
+            }
+        });
+    for (int i = 1; i <= 200; i++) {
+        setArgs(i, i);
+        config.reload();
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+    EXPECT_EQ(inconsistent.load(), 0);
+    EXPECT_EQ(config.read()->getFlag<int>(*subCmd, "high"), 200);
+}
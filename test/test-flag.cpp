@@ -1,8 +1,11 @@
 #include <iostream>
 #include <string>
+#include <limits>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <flag.hpp>
+#include <alloc-tracker.hpp>
 
 using namespace pnt_cli;
 using namespace std;
@@ -98,3 +101,198 @@ TEST_F(FlagSetTest, CustomFlagTypesWork) {
     EXPECT_EQ(fs.get<Hostname>(hostnameFlagShorthand)->name, "localhost");
     EXPECT_EQ(fs.get<Hostname>(hostnameFlagShorthand)->port, 8080);
 }
+TEST_F(FlagSetTest, NameAndShorthandConflictsAreRejected) {
+    addAllFlags();
+    EXPECT_FALSE(fs.addFlag<int>(intFlagName, intFlagDescription, intFlagDefault));
+    EXPECT_FALSE(fs.addFlag<int>("other_int_flag", intFlagDescription, intFlagDefault, intFlagShorthand));
+    EXPECT_FALSE(fs.addFlag<int>("long_shorthand_flag", intFlagDescription, intFlagDefault, "ls"));
+    EXPECT_EQ(fs.size(), 3);
+    EXPECT_FALSE(fs.find<int>("other_int_flag"));
+    EXPECT_FALSE(fs.find<int>("missing_flag"));
+    EXPECT_FALSE(fs.find<int>("x"));
+}
+TEST(FromStringTest, NumbersConvertInTheirExactType) {
+    int64_t i64 = 0;
+    EXPECT_EQ(tryFromString<int64_t>("9007199254740993", i64), ConversionError::none);
+    EXPECT_EQ(i64, 9007199254740993LL);
+    uint64_t u64 = 0;
+    EXPECT_EQ(tryFromString<uint64_t>("18446744073709551615", u64), ConversionError::none);
+    EXPECT_EQ(u64, std::numeric_limits<uint64_t>::max());
+    double d = 0;
+    EXPECT_EQ(tryFromString<double>("0.1", d), ConversionError::none);
+    EXPECT_EQ(d, 0.1);
+    EXPECT_EQ(fromString<double>(toString<double>(1.0 / 3)), 1.0 / 3);
+    EXPECT_EQ(fromString<int>("-12"), -12);
+}
+TEST(FromStringTest, MalformedInputIsReported) {
+    int8_t i8 = 7;
+    EXPECT_EQ(tryFromString<int8_t>("300", i8), ConversionError::out_of_range);
+    EXPECT_EQ(tryFromString<int8_t>("12abc", i8), ConversionError::invalid_argument);
+    EXPECT_EQ(tryFromString<int8_t>("", i8), ConversionError::invalid_argument);
+    EXPECT_EQ(i8, 7);
+    unsigned u = 1;
+    EXPECT_EQ(tryFromString<unsigned>("-1", u), ConversionError::invalid_argument);
+    float f = 0;
+    EXPECT_EQ(tryFromString<float>("1e100", f), ConversionError::out_of_range);
+    bool b = false;
+    EXPECT_EQ(tryFromString<bool>("yes", b), ConversionError::invalid_argument);
+    EXPECT_EQ(tryFromString<bool>("1", b), ConversionError::none);
+    EXPECT_TRUE(b);
+    EXPECT_THROW(fromString<int>("abc"), std::invalid_argument);
+    EXPECT_THROW(fromString<int64_t>("99999999999999999999"), std::out_of_range);
+    // set accepts what parsing does
+    EXPECT_TRUE(fromString<bool>("1"));
+    EXPECT_FALSE(fromString<bool>("0"));
+    EXPECT_THROW(fromString<bool>("garbage"), std::invalid_argument);
+}
+TEST_F(FlagSetTest, TrySetLeavesValueOnError) {
+    addIntFlag();
+    FlagRef f = fs.find_simple(intFlagName);
+    EXPECT_EQ(f.trySet("x"), ConversionError::invalid_argument);
+    EXPECT_EQ(fs.get<int>(intFlagName), intFlagDefault);
+    EXPECT_EQ(f.trySet("11"), ConversionError::none);
+    EXPECT_EQ(fs.get<int>(intFlagName), 11);
+}
+TEST_F(FlagSetTest, SmallArithmeticFlagsConvertAsTheyAreSet) {
+    fs.addFlag<short>("short_flag", "", 1);
+    fs.addFlag<unsigned char>("byte_flag", "", 2);
+    FlagRef s = fs.find_simple("short_flag");
+    FlagRef b = fs.find_simple("byte_flag");
+    EXPECT_EQ(s.trySet("x"), ConversionError::invalid_argument);
+    EXPECT_EQ(s.trySet("70000"), ConversionError::out_of_range);
+    EXPECT_EQ(b.trySet("256"), ConversionError::out_of_range);
+    EXPECT_EQ(s.trySet("-7"), ConversionError::none);
+    EXPECT_EQ(b.trySet("255"), ConversionError::none);
+    EXPECT_EQ(s.pendingValue(), "");
+    EXPECT_EQ(fs.get<short>("short_flag"), -7);
+    EXPECT_EQ(fs.get<unsigned char>("byte_flag"), 255);
+}
+
+TEST_F(FlagSetTest, ListFlagsCollectOccurrences) {
+    using Ids = std::vector<int>;
+    EXPECT_TRUE(fs.addFlag<Ids>("ids", "some ids", Ids{7}, "i"));
+    FlagRef f = fs.find_simple("ids");
+    EXPECT_EQ(fs.get<Ids>("ids"), Ids{7});
+    // the first occurrence replaces the default, later ones append
+    EXPECT_EQ(f.trySet("1,2"), ConversionError::none);
+    EXPECT_EQ(f.trySet("3"), ConversionError::none);
+    EXPECT_EQ(fs.get<Ids>("ids"), (Ids{1, 2, 3}));
+    EXPECT_EQ(f.trySet("4,x,5"), ConversionError::invalid_argument);
+    EXPECT_EQ(f.trySet("4,"), ConversionError::invalid_argument);
+    EXPECT_EQ(fs.get<Ids>("ids"), (Ids{1, 2, 3}));
+    EXPECT_THROW(f.set("99999999999"), std::out_of_range);
+    f.reset();
+    EXPECT_EQ(fs.get<Ids>("ids"), Ids{7});
+
+    // delimiters on both sides of 16 byte block boundaries
+    Ids many;
+    std::string str;
+    for (int i = 0; i < 1000; i++) {
+        many.push_back(i * 37 - 500);
+        str += (i ? "," : "") + std::to_string(many.back());
+    }
+    EXPECT_EQ(fromString<Ids>(str), many);
+    EXPECT_EQ(toString(many), str);
+    EXPECT_EQ(fromString<std::vector<std::string>>("a,,b c"), (std::vector<std::string>{"a", "", "b c"}));
+    EXPECT_TRUE(fromString<Ids>("").empty());
+}
+
+TEST_F(FlagSetTest, LookupsDontAllocate) {
+    addAllFlags();
+    const std::string value = "1234";
+    alloc_tracker::AllocationCounter allocs;
+    EXPECT_TRUE(fs.find<int>(intFlagName));
+    EXPECT_TRUE(fs.find<int>(intFlagShorthand));
+    EXPECT_FALSE(fs.find<int>("missing_flag"));
+    EXPECT_EQ(fs.get<int>(intFlagName), intFlagDefault);
+    EXPECT_EQ(fs.get<float>(floatFlagShorthand), floatFlagDefault);
+    EXPECT_TRUE(fs.set<int>(intFlagName, value));
+    EXPECT_EQ(allocs.count(), 0u);
+}
+
+TEST_F(FlagSetTest, BuiltinAndCustomFlagsResetTogether) {
+    addAllFlags();
+    // many built-in flags alongside the custom ones
+    for (int i = 0; i < 100; i++)
+        fs.addFlag<long>("long_flag_" + std::to_string(i), "", i);
+    fs.addFlag<std::string>("string_flag", "", "default");
+    EXPECT_EQ(fs.size(), 104u);
+    // built-in values are stored by value, in one contiguous array per type
+    EXPECT_EQ(fs.getIf<long>("long_flag_1"), fs.getIf<long>("long_flag_0") + 1);
+    EXPECT_EQ(fs.getIf<long>("long_flag_99"), fs.getIf<long>("long_flag_0") + 99);
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ(fs.find_simple("long_flag_" + std::to_string(i)).trySet(std::to_string(-i)), ConversionError::none);
+    EXPECT_EQ(fs.find_simple(intFlagName).trySet("x"), ConversionError::invalid_argument);
+    EXPECT_EQ(fs.find_simple(intFlagName).trySet("7"), ConversionError::none);
+    EXPECT_TRUE(fs.set<std::string>("string_flag", "value"));
+    EXPECT_TRUE(fs.set<Hostname>(hostnameFlagName, "example.com:443"));
+    EXPECT_EQ(fs.get<long>("long_flag_99"), -99);
+    EXPECT_EQ(fs.get<int>(intFlagName), 7);
+    EXPECT_EQ(fs.get<std::string>("string_flag"), "value");
+    fs.reset();
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ(fs.get<long>("long_flag_" + std::to_string(i)), i);
+    EXPECT_EQ(fs.get<int>(intFlagName), intFlagDefault);
+    EXPECT_EQ(fs.get<std::string>("string_flag"), "default");
+    EXPECT_EQ(fs.get<Hostname>(hostnameFlagName)->port, hostnameFlagDefault.port);
+}
+
+TEST_F(FlagSetTest, StringViewFlagsViewTheirToken) {
+    fs.addFlag<std::string_view>("view_flag", "", "default", "w");
+    fs.addFlag<std::string>("string_flag", "", "default");
+    char token[] = "from-argv";
+    alloc_tracker::AllocationCounter allocs;
+    EXPECT_EQ(fs.find_simple("w").trySet(token), ConversionError::none);
+    const std::string_view* view = fs.getIf<std::string_view>("view_flag");
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(view->data(), token);
+    EXPECT_EQ(*fs.getIf<std::string>("string_flag"), "default");
+    EXPECT_EQ(fs.getIf<std::string>("view_flag"), nullptr);
+    EXPECT_EQ(allocs.count(), 0u);
+    // captured values (e.g. config snapshots) own their text
+    FlagSet::Values captured = fs.capture();
+    token[0] = 'F';
+    EXPECT_EQ(captured.get<std::string_view>(fs.find_simple("view_flag")), "from-argv");
+    EXPECT_EQ(*view, "From-argv");
+    {
+        std::string temporary = "copied";
+        EXPECT_TRUE(fs.set<std::string_view>("view_flag", temporary));
+    }
+    EXPECT_EQ(fs.get<std::string_view>("view_flag"), "copied");
+    fs.reset();
+    EXPECT_EQ(fs.get<std::string_view>("view_flag"), "default");
+    fs.restore(captured);
+    EXPECT_EQ(fs.get<std::string_view>("view_flag"), "from-argv");
+    EXPECT_NE(fs.getIf<std::string_view>("view_flag")->data(), token);
+}
+
+TEST_F(FlagSetTest, DeferredFlagsCopyOnlyTokensThatMayNotOutliveThem) {
+    addHostnameFlag();
+    FlagRef f = fs.find_simple(hostnameFlagName);
+    char token[] = "parsed.com:80";
+    {
+        alloc_tracker::AllocationCounter allocs;
+        EXPECT_EQ(f.trySet(token), ConversionError::none);
+        EXPECT_EQ(allocs.count(), 0u);
+    }
+    EXPECT_EQ(f.pendingValue().data(), token);
+    EXPECT_EQ(fs.get<Hostname>(hostnameFlagName)->port, 80);
+    // as config files and the environment set it
+    std::string temporary = "copied.com:8080";
+    EXPECT_EQ(f.trySetCopy(temporary), ConversionError::none);
+    EXPECT_NE(f.pendingValue().data(), temporary.data());
+    temporary.assign(temporary.size(), 'x');
+    EXPECT_EQ(fs.get<Hostname>(hostnameFlagName)->name, "copied.com");
+    EXPECT_EQ(fs.get<Hostname>(hostnameFlagName)->port, 8080);
+}
+
+TEST_F(FlagSetTest, LookupsFindEveryFlagOfLargeSets) {
+    // enough flags to grow the name table several times
+    for (int i = 0; i < 1000; i++)
+        EXPECT_TRUE(fs.addFlag<int>("flag_" + std::to_string(i), "", i));
+    EXPECT_FALSE(fs.addFlag<int>("flag_500", "", 0));
+    for (int i = 0; i < 1000; i++)
+        EXPECT_EQ(fs.get<int>("flag_" + std::to_string(i)), i);
+    EXPECT_FALSE(fs.find_simple("flag_1000"));
+    EXPECT_FALSE(fs.find_simple("flag_"));
+}
@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <sstream>
+#include <cstdio>
+
+#include <gtest/gtest.h>
+#include <log.hpp>
+
+using namespace pnt_cli::logging;
+using namespace std;
+
+// reads back what was written to a temporary file
+static std::string contents(std::FILE* file) {
+    std::string str;
+    std::rewind(file);
+    char buf[4096];
+    for (size_t n; (n = std::fread(buf, 1, sizeof(buf), file)) > 0; )
+        str.append(buf, n);
+    return str;
+}
+
+TEST(AsyncLoggerTest, WritesRecordsOfAllProducersInOrder) {
+    std::FILE* out = std::tmpfile();
+    std::FILE* err = std::tmpfile();
+    const int threads = 4, messages = 3000;
+    const std::string longMessage(500, 'x');
+    {
+        AsyncLogger logger(::fileno(out), ::fileno(err));
+        std::vector<std::thread> producers;
+        for (int t = 0; t < threads; t++)
+            producers.emplace_back([&, t] {
+                for (int i = 0; i < messages; i++)
+                    logger.log(AsyncLogger::Stream::out, "LOG", "thread ", std::to_string(t), " message ", std::to_string(i), "\n");
+            });
+        for (auto& producer : producers) producer.join();
+        logger.log(AsyncLogger::Stream::err, "ERROR", longMessage, "\n");
+        logger.flush();
+        EXPECT_NE(contents(err).find(longMessage), std::string::npos);
+    }
+
+    std::istringstream lines(contents(out));
+    std::vector<int> next(threads, 0);
+    int count = 0;
+    for (std::string line; std::getline(lines, line); count++) {
+        ASSERT_TRUE(line.starts_with("[LOG ")) << line;
+        auto body = line.substr(line.find("]: ") + 3);
+        int t, i;
+        ASSERT_EQ(std::sscanf(body.c_str(), "thread %d message %d", &t, &i), 2) << line;
+        EXPECT_EQ(i, next[t]++);
+    }
+    EXPECT_EQ(count, threads * messages);
+    std::fclose(out);
+    std::fclose(err);
+}
+
+// counts how often it was formatted
+struct CountingArg {
+    static inline int conversions = 0;
+    operator std::string_view() const { conversions++; return "counted"; }
+};
+
+TEST(LogLevelTest, DisabledLevelsDoNotFormatArguments) {
+    static_assert(!enabled<Level::trace>);
+    static_assert(enabled<Level::error>);
+    static_assert(!enabled<Level::off>);
+    CountingArg::conversions = 0;
+    log<Level::trace>("never ", CountingArg{}, " formatted");
+    EXPECT_EQ(CountingArg::conversions, 0);
+}
+
+TEST(LogLevelTest, ArgumentsAreFormattedInPlace) {
+    auto str = [] (const auto& arg) { return std::string(std::string_view(detail::format_arg(arg))); };
+    EXPECT_EQ(str(42), "42");
+    EXPECT_EQ(str(-7L), "-7");
+    EXPECT_EQ(str(1.5), "1.5");
+    EXPECT_EQ(str(true), "true");
+    EXPECT_EQ(str('x'), "x");
+    EXPECT_EQ(str("text"), "text");
+    EXPECT_EQ(str(std::string("string")), "string");
+    EXPECT_EQ(str(CountingArg{}), "counted");
+}
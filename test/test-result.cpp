@@ -0,0 +1,88 @@
+// Built with -fno-exceptions: the try* API must neither throw nor exit
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <command.hpp>
+#include <schema.hpp>
+
+using namespace pnt_cli;
+using namespace std;
+
+class ResultTest : public ::testing::Test {
+    protected:
+        shared_ptr<Command> rootCmd;
+        shared_ptr<Command> subCmd;
+        std::vector<std::string> args_;
+        std::vector<char*> argv_;
+
+        void SetUp() override {
+            rootCmd = makeCommand("tool", "some description", [] (Command const&, Args) { return 1; });
+            ASSERT_TRUE(rootCmd->tryAddPersistentFlag<int>("count", "a count", 0, "c"));
+            subCmd = rootCmd->addSubcommand("build", "build description", nullptr);
+            ASSERT_TRUE(subCmd->tryAddLocalFlag<bool>("release", "release build", false));
+        }
+        Result<int> execute(std::vector<std::string> args) {
+            args_ = std::move(args);
+            args_.insert(args_.begin(), "tool");
+            argv_.clear();
+            for (auto& arg : args_) argv_.push_back(arg.data());
+            return rootCmd->tryExecute(argv_.size(), argv_.data());
+        }
+        void expectError(std::vector<std::string> args, ErrorCode code, int index, std::string token, std::string command) {
+            auto result = execute(args);
+            ASSERT_FALSE(result);
+            EXPECT_EQ(result.error().code, code);
+            EXPECT_EQ(result.error().index, index);
+            EXPECT_EQ(result.error().token, token);
+            EXPECT_EQ(result.error().command, command);
+        }
+};
+
+TEST_F(ResultTest, ParseErrorsAreReturned) {
+    EXPECT_EQ(execute({"-c", "2"}).value(), 1);
+    expectError({"x", "--missing"}, ErrorCode::unknown_flag, 2, "--missing", "tool");
+    expectError({"build", "--release", "--count"}, ErrorCode::missing_value, 3, "--count", "tool build");
+    expectError({"--count=x"}, ErrorCode::invalid_value, 1, "--count=x", "tool");
+    EXPECT_EQ(execute({"--count=x"}).error().detail, "x");
+    expectError({"--count", "99999999999"}, ErrorCode::out_of_range, 1, "--count", "tool");
+    expectError({"--x"}, ErrorCode::invalid_flag_name, 1, "--x", "tool");
+    expectError({"a", "@/nonexistent/file"}, ErrorCode::file_error, 2, "/nonexistent/file", "tool");
+    expectError({"build"}, ErrorCode::no_action, -1, "", "tool build");
+    EXPECT_EQ(execute({"build", "-c", "x"}).error().message(), "invalid value: -c: x (in tool build)");
+
+    std::string arg0 = "tool", arg1 = "build";
+    char* argv[] = {arg0.data(), arg1.data()};
+    auto parsed = rootCmd->tryParse(2, argv);
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(*parsed, subCmd.get());
+}
+
+TEST_F(ResultTest, RegistrationErrorsAreReturned) {
+    auto conflict = subCmd->tryAddLocalFlag<int>("count", "shadows a persistent flag", 0);
+    ASSERT_FALSE(conflict);
+    EXPECT_EQ(conflict.error().code, ErrorCode::name_conflict);
+    EXPECT_EQ(conflict.error().command, "tool build");
+    EXPECT_EQ(subCmd->tryAddLocalFlag<int>("other", "", 0, "c").error().code, ErrorCode::name_conflict);
+    EXPECT_EQ(subCmd->tryAddLocalFlag<int>("other", "", 0, "xy").error().code, ErrorCode::invalid_shorthand);
+    auto other = subCmd->tryAddLocalFlag<int>("other", "", 4, "o");
+    ASSERT_TRUE(other);
+    EXPECT_EQ(other->get(), 4);
+}
+
+static constexpr auto tool = schema::command("tool", "some description",
+    schema::flags(schema::flag<int>("count", "a count", 0, 'c')),
+    schema::subcommands(schema::command("build", "build description"))
+);
+
+TEST(SchemaResultTest, ParseErrorsAreReturned) {
+    schema::Cli<tool> cli;
+    cli.bind<"">([] (schema::Cli<tool> const&, Args) { return 1; });
+    std::vector<std::string> args = {"tool", "build", "--count", "1"};
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(arg.data());
+    auto result = cli.tryExecute(argv.size(), argv.data());
+    ASSERT_FALSE(result);
+    EXPECT_EQ(result.error().code, ErrorCode::unknown_flag);
+    EXPECT_EQ(result.error().command, "tool build");
+}
@@ -0,0 +1,134 @@
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <schema.hpp>
+#include <alloc-tracker.hpp>
+
+using namespace pnt_cli;
+using namespace std;
+
+static constexpr auto tool = schema::command("tool", "some description",
+    schema::flags(
+        schema::persistentFlag<bool>("verbose", "verbose output", false, 'v'),
+        schema::flag<int>("count", "a count", 1, 'c')
+    ),
+    schema::subcommands(
+        schema::command("build", "build description",
+            schema::flags(
+                schema::flag<std::string>("out", "output path", "a.out", 'o'),
+                schema::flag<double>("ratio", "a ratio", 0.5)
+            )
+        ),
+        schema::command("test", "test description")
+    )
+);
+static constexpr auto conflictingNames = schema::command("tool", "some description",
+    schema::flags(schema::persistentFlag<bool>("verbose", "verbose output", false)),
+    schema::subcommands(
+        schema::command("build", "build description", schema::flags(schema::flag<int>("verbose", "verbosity", 0)))
+    )
+);
+static constexpr auto conflictingShorthands = schema::command("tool", "some description",
+    schema::flags(
+        schema::flag<bool>("verbose", "verbose output", false, 'v'),
+        schema::flag<int>("value", "a value", 0, 'v')
+    )
+);
+static constexpr auto conflictingSubcommands = schema::command("tool", "some description",
+    schema::flags(),
+    schema::subcommands(schema::command("build", "build"), schema::command("build", "build again"))
+);
+// local flags of different commands may share names
+static constexpr auto siblingLocalFlags = schema::command("tool", "some description",
+    schema::flags(schema::flag<int>("count", "a count", 0)),
+    schema::subcommands(schema::command("build", "build", schema::flags(schema::flag<int>("count", "a count", 0))))
+);
+
+static_assert(schema::is_valid<tool>);
+static_assert(!schema::is_valid<conflictingNames>);
+static_assert(!schema::is_valid<conflictingShorthands>);
+static_assert(!schema::is_valid<conflictingSubcommands>);
+static_assert(schema::is_valid<siblingLocalFlags>);
+
+class SchemaTest : public ::testing::Test {
+    protected:
+        schema::Cli<tool> cli;
+        std::vector<std::string> args_;
+        std::vector<char*> argv_;
+
+        static std::vector<std::string> positionals;
+
+        void SetUp() override {
+            positionals.clear();
+            cli.bind<"">([] (schema::Cli<tool> const&, Args) { return 1; });
+            cli.bind<"build">([] (schema::Cli<tool> const&, Args args) {
+                for (auto arg : args) positionals.emplace_back(arg);
+                return 2;
+            });
+        }
+        int execute(std::vector<std::string> args) {
+            args_ = std::move(args);
+            args_.insert(args_.begin(), "tool");
+            argv_.clear();
+            for (auto& arg : args_) argv_.push_back(arg.data());
+            return cli.execute(argv_.size(), argv_.data());
+        }
+};
+std::vector<std::string> SchemaTest::positionals;
+
+TEST_F(SchemaTest, InitializesWithDefaults) {
+    EXPECT_FALSE(cli.get<"verbose">());
+    EXPECT_EQ(cli.get<"count">(), 1);
+    EXPECT_EQ((cli.get<"out", "build">()), "a.out");
+    EXPECT_EQ((cli.get<"ratio", "build">()), 0.5);
+    EXPECT_FALSE((cli.get<"verbose", "build">()));
+}
+
+TEST_F(SchemaTest, ParsesAndDispatches) {
+    EXPECT_EQ(execute({"-c", "3", "-v"}), 1);
+    EXPECT_EQ(cli.command(), "tool");
+    EXPECT_EQ(cli.get<"count">(), 3);
+    EXPECT_TRUE(cli.get<"verbose">());
+    cli.reset();
+    EXPECT_EQ(execute({"--count=4", "build", "-ofile", "x", "--ratio", "0.25", "--", "-y"}), 2);
+    EXPECT_EQ(cli.command(), "build");
+    EXPECT_EQ(cli.get<"count">(), 4);
+    EXPECT_EQ((cli.get<"out", "build">()), "file");
+    EXPECT_EQ((cli.get<"ratio", "build">()), 0.25);
+    EXPECT_EQ(positionals, (std::vector<std::string>{"x", "-y"}));
+    EXPECT_THROW(execute({"build", "--count", "1"}), std::runtime_error);
+    EXPECT_THROW(execute({"test"}), std::runtime_error);
+}
+
+TEST_F(SchemaTest, ParsingAllocatesNothing) {
+    std::string path = (std::filesystem::temp_directory_path() / ("pnt-cli-test-" + std::to_string(::getpid()) + ".rsp")).string();
+    std::ofstream(path) << "y --ratio 0.75 z\n";
+    args_ = {"tool", "-v", "build", "x", "--out", "an/output/path/longer/than/any/small/string", "@" + path, "w"};
+    for (auto& arg : args_) argv_.push_back(arg.data());
+    cli.bind<"build">([] (schema::Cli<tool> const&, Args args) {
+        return static_cast<int>(std::ranges::distance(args.begin(), args.end()));
+    });
+    {
+        alloc_tracker::AllocationCounter allocs;
+        EXPECT_EQ(cli.execute(argv_.size(), argv_.data()), 4);
+        EXPECT_EQ(allocs.count(), 0u);
+    }
+    EXPECT_TRUE(cli.get<"verbose">());
+    EXPECT_EQ((cli.get<"out", "build">()), "an/output/path/longer/than/any/small/string");
+    EXPECT_EQ((cli.get<"ratio", "build">()), 0.75);
+
+    // x, y, z and w make four runs
+    schema::Cli<tool, 3> small;
+    small.bind<"build">([] (schema::Cli<tool, 3> const&, Args) { return 0; });
+    argv_.clear();
+    for (auto& arg : args_) argv_.push_back(arg.data());
+    auto res = small.tryExecute(argv_.size(), argv_.data());
+    ASSERT_FALSE(res);
+    EXPECT_EQ(res.error().code, ErrorCode::too_many_args);
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,126 @@
+#include <string>
+#include <fstream>
+#include <vector>
+#include <filesystem>
+
+#include <gtest/gtest.h>
+#include <source.hpp>
+
+using namespace pnt_cli;
+using namespace std;
+
+class SourceTest : public ::testing::Test {
+    protected:
+        shared_ptr<Command> rootCmd;
+        shared_ptr<Command> subCmd;
+        shared_ptr<Command> subSubCmd;
+        std::string path_;
+
+        void SetUp() override {
+            auto action = [] (Command const&, Args) { return 0; };
+            rootCmd = makeCommand("some_command", "some description", action);
+            rootCmd->addPersistentFlag<bool>("verbose", "verbose output", false, "v");
+            rootCmd->addLocalFlag<int>("count", "a count", 1);
+            subCmd = rootCmd->addSubcommand("build", "build description", action);
+            subCmd->addLocalFlag<std::string>("out", "output path", "a.out");
+            subSubCmd = subCmd->addSubcommand("release", "release description", action);
+            subSubCmd->addLocalFlag<double>("ratio", "a ratio", 0.5);
+            path_ = (std::filesystem::temp_directory_path() / ("pnt-cli-test-" + std::to_string(::getpid()) + ".ini")).string();
+        }
+        void TearDown() override {
+            std::filesystem::remove(path_);
+        }
+        void writeFile(const std::string& contents) {
+            std::ofstream(path_) << contents;
+        }
+};
+
+TEST_F(SourceTest, AppliesKeysBySection) {
+    writeFile(
+        "# a comment\n"
+        "count = 3\n"
+        "\n"
+        "[build]\r\n"
+        "  verbose=true\n"
+        "out = \"some file # not a comment\"  # a comment\n"
+        "[ build.release ]\n"
+        "ratio = 0.25"
+    );
+    ConfigFile(path_).apply(*rootCmd);
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 3);
+    EXPECT_EQ(rootCmd->getFlag<bool>("verbose"), true);
+    EXPECT_EQ(subCmd->getFlag<std::string>("out"), "some file # not a comment");
+    EXPECT_EQ(subSubCmd->getFlag<double>("ratio"), 0.25);
+}
+
+TEST_F(SourceTest, SectionsResolveAliasesButNotPrefixes) {
+    subCmd->addAlias("b");
+    rootCmd->setPrefixMatching();
+    writeFile("[b]\nout = aliased\n[b.release]\nratio = 0.125\n");
+    ConfigFile(path_).apply(*rootCmd);
+    EXPECT_EQ(subCmd->getFlag<std::string>("out"), "aliased");
+    EXPECT_EQ(subSubCmd->getFlag<double>("ratio"), 0.125);
+    writeFile("[bui]\nout = prefixed\n");
+    EXPECT_THROW(ConfigFile(path_).apply(*rootCmd), std::runtime_error);
+}
+
+TEST_F(SourceTest, ReportsErrorsWithLineNumbers) {
+    auto expectError = [this] (const std::string& contents, const std::string& msg) {
+        writeFile(contents);
+        try {
+            ConfigFile(path_).apply(*rootCmd);
+            FAIL() << "expected an error for: " << contents;
+        } catch (const std::runtime_error& e) {
+            EXPECT_EQ(std::string(e.what()), path_ + ":" + msg);
+        }
+    };
+    expectError("count = 1\nmissing = 2\n", "2: Unknown flag: missing");
+    expectError("[build]\ncount = 1\n", "2: Unknown flag: count");
+    expectError("[deploy]\n", "1: Unknown command: deploy");
+    expectError("count = x\n", "1: Invalid value for flag count: invalid argument: x");
+    expectError("count\n", "1: Expected key = value: count");
+    expectError("out = \"a.out\n", "1: Unterminated string: \"a.out");
+    EXPECT_THROW(ConfigFile(path_ + ".missing"), std::runtime_error);
+}
+
+TEST_F(SourceTest, BindsEnvironmentVariables) {
+    EnvSource source("APP");
+    EXPECT_EQ(source.variableName("", "verbose"), "APP_VERBOSE");
+    EXPECT_EQ(source.variableName("build release", "some-ratio"), "APP_BUILD_RELEASE_SOME_RATIO");
+    std::vector<std::string> vars = {
+        "PATH=/usr/bin", "APP_COUNT=4", "APP_BUILD_OUT=out=file", "APP_BUILD_RELEASE_RATIO=0.75",
+        "APP_BUILD_VERBOSE=true", "APPLE=1", "APP_"
+    };
+    std::vector<char*> env;
+    for (auto& var : vars) env.push_back(var.data());
+    env.push_back(nullptr);
+    source.apply(*rootCmd, env.data());
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 4);
+    EXPECT_EQ(subCmd->getFlag<std::string>("out"), "out=file");
+    EXPECT_EQ(subSubCmd->getFlag<double>("ratio"), 0.75);
+    // persistent flags are only bound through the command defining them
+    EXPECT_EQ(rootCmd->getFlag<bool>("verbose"), false);
+
+    std::string invalid = "APP_COUNT=many";
+    char* invalidEnv[] = {invalid.data(), nullptr};
+    EXPECT_THROW(source.apply(*rootCmd, invalidEnv), std::runtime_error);
+    // the `build` flag `out` and the root flag `build-out` would share a variable
+    rootCmd->addLocalFlag<int>("build-out", "conflicting", 0);
+    EXPECT_THROW(source.apply(*rootCmd, env.data()), std::runtime_error);
+}
+
+TEST_F(SourceTest, ArgvOverridesEnvironmentOverridesFile) {
+    writeFile("count = 2\n[build]\nout = file\n");
+    std::string var = "APP_COUNT=3";
+    char* env[] = {var.data(), nullptr};
+    ConfigFile(path_).apply(*rootCmd);
+    EnvSource("APP").apply(*rootCmd, env);
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 3);
+    EXPECT_EQ(subCmd->getFlag<std::string>("out"), "file");
+    std::vector<std::string> args = {"some_command", "build", "--out", "arg"};
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(arg.data());
+    rootCmd->parse(argv.size(), argv.data());
+    EXPECT_EQ(rootCmd->getFlag<int>("count"), 3);
+    EXPECT_EQ(subCmd->getFlag<std::string>("out"), "arg");
+}